@@ -0,0 +1,83 @@
+/* bench_gedf.c
+ * Throughput of the global EDF model, see gedf.c, from 1 to 8
+ * simulated cores. It measures gedf.c, not the kernel, which is single
+ * core.
+ *   make host/bench_gedf
+ * TASKS tasks of WORK loop iterations each are ready at the start with
+ * spread deadlines. Every fourth one creates a short child with an
+ * earlier deadline halfway, which preempts the core running the latest
+ * deadline. Reported per core count: wall time, tasks per second, the
+ * speedup over one core and the scheduler counters. A simulated core
+ * is a thread, so the speedup is bounded by the CPUs of the host,
+ * printed first. Rows with more cores than host CPUs are marked with
+ * a *: their cores take turns on the CPUs, it is not scaling. Tasks
+ * poll for preemption every POLL iterations.
+ */
+#include "gedf.h"
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TASKS           192
+#define WORK            2000000
+#define CHILD_WORK      (WORK / 10)
+#define DEADLINE(i)     (1000 + (i) * 8)
+#define POLL            4096            // Iterations between preemption points
+
+static volatile uint nDone;
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void spin(uint n){
+	volatile uint i;
+	for(i = 0; i < n; i++)
+		if(i % POLL == 0) gedf_poll();
+}
+
+static void child(void* pArg){
+	(void)pArg;
+	spin(CHILD_WORK);
+	__atomic_add_fetch(&nDone, 1, __ATOMIC_RELAXED);
+}
+
+static void task(void* pArg){
+	uint i = (uint)(unsigned long)pArg;
+	spin(WORK / 2);
+	if(i % 4 == 0)
+		gedf_create(child, NULL, DEADLINE(i) / 2);
+	spin(WORK / 2);
+	__atomic_add_fetch(&nDone, 1, __ATOMIC_RELAXED);
+}
+
+int main(void)
+{
+	uint nCores, i;
+	double t1 = 0;
+	long nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	printf("host CPUs %ld\n", nCpus);
+	printf("%5s %10s %10s %8s %10s %10s %10s %8s\n", "cores", "ms", "tasks/s", "speedup",
+	       "dispatch", "preempt", "migrate", "request");
+	for(nCores = 1; nCores <= GEDF_MAX_CORES; nCores *= 2){
+		gedfstat s;
+		double t0, t;
+		nDone = 0;
+		gedf_init(nCores);
+		for(i = 0; i < TASKS; i++)
+			gedf_create(task, (void*)(unsigned long)i, DEADLINE(i));
+		t0 = now_ns();
+		gedf_run();
+		t = now_ns() - t0;
+		if(nCores == 1) t1 = t;
+		gedf_stats(&s);
+		printf("%5u %10.1f %10.0f %8.2f %10u %10u %10u %8u%s\n", nCores, t / 1e6, nDone / (t / 1e9),
+		       t1 / t, s.nDispatches, s.nPreemptions, s.nMigrations, s.nRequests,
+		       (long)nCores > nCpus ? " *" : "");
+	}
+	if(nCpus < GEDF_MAX_CORES)
+		printf("* more cores than the %ld host CPUs, time-shared\n", nCpus);
+	return 0;
+}
@@ -0,0 +1,106 @@
+/* bench_heap.c
+ * Host comparison of the message data allocator, tlsf.c, with
+ * calloc/free for mixed payload sizes.
+ * Build, e.g.
+ *   gcc -O2 -o bench_heap bench_heap.c tlsf.c
+ * A fixed number of live buffers of 4 to 512 bytes is kept while
+ * random buffers are freed and allocated again, the pattern of
+ * mailboxes with different nDataSize. Reports mean, 99th percentile and
+ * worst-case nanoseconds per allocation plus free, and for TLSF the
+ * peak use and the fragmentation of the free space at the end. The
+ * "clock" row is the cost of the timing itself, with no operation.
+ */
+#include "kernel.h"
+#include "tlsf.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define ARENA           (256 * 1024)
+#define LIVE            512
+#define OPS             200000
+
+static tlsf t;
+static char arena[ARENA];
+static void* live[LIVE];
+static double sample[OPS];
+static uint seed = 1;
+
+static uint rnd(void){
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static uint payload(void){
+	//Mostly small, a few large
+	static const uint nSizes[] = {4, 8, 12, 16, 24, 32, 48, 64, 100, 128, 256, 512};
+	return nSizes[rnd() % (sizeof(nSizes) / sizeof(nSizes[0]))];
+}
+
+static int cmp(const void* a, const void* b){
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(const char* name, int mode){
+	uint i;
+	double t0, dt, sum = 0, worst = 0;
+	seed = 1;
+	for(i = 0; i < LIVE; i++){
+		uint n = payload();
+		live[i] = mode == 1 ? tlsf_alloc(&t, n) : calloc(1, n);
+	}
+	for(i = 0; i < OPS; i++){
+		uint j = rnd() % LIVE;
+		uint n = payload();
+		t0 = now_ns();
+		if(mode == 1){ //As create_data() with no data
+			tlsf_free(&t, live[j]);
+			live[j] = tlsf_alloc(&t, n);
+			memset(live[j], 0, n);
+		}else if(mode == 2){
+			free(live[j]);
+			live[j] = calloc(1, n);
+		}
+		dt = now_ns() - t0;
+		sample[i] = dt;
+		sum += dt;
+		if(dt > worst) worst = dt;
+	}
+	for(i = 0; i < LIVE; i++){
+		if(mode == 1) tlsf_free(&t, live[i]);
+		else free(live[i]);
+	}
+	qsort(sample, OPS, sizeof(double), cmp);
+	printf("%-8s %12.1f %12.1f %12.1f\n", name, sum / OPS, sample[OPS * 99 / 100], worst);
+}
+
+int main(void){
+	heapstat s;
+	uint i, nLive = 0;
+	tlsf_init(&t, arena, ARENA);
+	printf("%-8s %12s %12s %12s\n", "", "mean ns", "p99 ns", "worst ns");
+	bench("clock", 0);
+	bench("calloc", 2);
+	bench("tlsf", 1);
+
+	seed = 1; //Same pattern again, stopped with the buffers live
+	for(i = 0; i < LIVE; i++) live[i] = tlsf_alloc(&t, payload());
+	for(i = 0; i < OPS; i++){
+		uint j = rnd() % LIVE;
+		tlsf_free(&t, live[j]);
+		live[j] = tlsf_alloc(&t, payload());
+	}
+	for(i = 0; i < LIVE; i++) nLive += live[i] != NULL;
+	tlsf_stats(&t, &s);
+	printf("tlsf arena %u, peak %u, free %u, largest free %u, fragmentation %.1f%%, failed %u, live %u\n",
+		s.nSize, s.nPeak, s.nFree, s.nLargestFree,
+		s.nFree ? 100.0 * (1.0 - (double)s.nLargestFree / s.nFree) : 0.0, s.nExhausted, nLive);
+	return 0;
+}
@@ -0,0 +1,207 @@
+/* bench_kernel.c
+ * Latency of the kernel API, measured by kernel tasks that drive each
+ * call in a tight loop. Runs on the board and on the host port:
+ *   host    make host/bench_kernel, times in TSC cycles
+ *   board   art-arm.ewp with bench_kernel.c built instead of main.c,
+ *           times in timer0 counts, TIMER0_TICK per tick
+ * Operations:
+ *   pingpong    send_wait + receive_wait round trip between two tasks
+ *   deadline    set_deadline that hands over to the other task, from
+ *               the call to the other task running
+ *   create      create_task of an earlier task, from the call to the
+ *               new task running
+ *   wakeup      from the timer interrupt to a task leaving wait(1),
+ *               with N other tasks ready. Includes TimerInt().
+ * Output is CSV on stdout, one line per operation:
+ *   op,tasks,samples,min,median,p99,max,unit
+ * A driver task with a later deadline than every benchmark task starts
+ * each benchmark and prints its line when all its tasks are done.
+ */
+#include "kernel.h"
+#include "kernel_hwdep.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__ICCARM__)
+#define UNIT            "timer"
+static uint cycles(void){
+	uint n;
+	isr_off();
+	n = ticks() * TIMER0_TICK + timer0_count();
+	isr_on();
+	return n;
+}
+#else
+#include <x86intrin.h>
+#define UNIT            "tsc"
+#define cycles()        ((uint)__rdtsc())
+#endif
+
+#define SAMPLES         1000
+#define TICK_SAMPLES    200     // One tick each
+#define EARLY           1000000 // Deadlines of the benchmark tasks
+#define DRIVER          2000000 // Deadline of the driver, after all of them
+
+static const uint nFillers[] = {0, 8, 24};
+
+static uint sample[SAMPLES];
+static uint nSamples;
+static volatile uint t0;        // Start time set by the task switching away
+static volatile uint bStop;
+static uint nLive;              // Benchmark tasks not yet finished
+static mailbox* mbGo;           // Benchmark tasks wait here until all exist
+static mailbox* mbDone;
+static mailbox* mbPing;
+static mailbox* mbPong;
+
+static void record(uint t){
+	if(nSamples < SAMPLES) sample[nSamples++] = t;
+}
+
+static void gate(void){
+	int x;
+	receive_wait(mbGo, &x);
+}
+
+static void finish(void){
+	int x = 0;
+	if(--nLive == 0) send_no_wait(mbDone, &x);
+}
+
+static void spawn(void (*body)(void), uint nDeadline){
+	if(create_task(body, nDeadline) != OK){
+		printf("error,create_task\n");
+		exit(1);
+	}
+}
+
+static int cmp(const void* a, const void* b){
+	uint x = *(const uint*)a, y = *(const uint*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void go(uint nTasks){
+	//Release the benchmark tasks together, return when all are done
+	static int data[MAX_TASKS];
+	int x;
+	nSamples = 0;
+	nLive = nTasks;
+	bStop = FALSE;
+	send_no_wait_n(mbGo, data, nTasks);
+	receive_wait(mbDone, &x);
+}
+
+static void report(const char* pOp, uint nTasks){
+	qsort(sample, nSamples, sizeof(uint), cmp);
+	printf("%s,%u,%u,%u,%u,%u,%u,%s\n", pOp, nTasks, nSamples, sample[0], sample[nSamples / 2],
+	       sample[nSamples * 99 / 100], sample[nSamples - 1], UNIT);
+}
+
+static void ping(void){
+	int x = 0;
+	uint i, t;
+	gate();
+	for(i = 0; i <= SAMPLES; i++){ //First round trip is warm-up
+		t = cycles();
+		send_wait(mbPing, &x);
+		receive_wait(mbPong, &x);
+		if(i) record(cycles() - t);
+	}
+	finish();
+}
+
+static void pong(void){
+	int x;
+	uint i;
+	gate();
+	for(i = 0; i <= SAMPLES; i++){
+		receive_wait(mbPing, &x);
+		send_wait(mbPong, &x);
+	}
+	finish();
+}
+
+static void flip(void){
+	//Two of these take turns, each moves its deadline past the other
+	gate();
+	while(nSamples < SAMPLES){
+		t0 = cycles();
+		set_deadline(deadline() + 2);
+		record(cycles() - t0);
+	}
+	finish();
+}
+
+static void child(void){
+	record(cycles() - t0);
+}
+
+static void spawner(void){
+	gate();
+	while(nSamples < SAMPLES){
+		t0 = cycles();
+		create_task(child, deadline() - 1);
+	}
+	finish();
+}
+
+static void sleeper(void){
+	uint i;
+	gate();
+	for(i = 0; i < TICK_SAMPLES; i++){
+		wait(1);
+		record(timer0_count());
+	}
+	bStop = TRUE;
+	finish();
+}
+
+static void filler(void){
+	gate();
+	while(!bStop)
+		;
+	finish();
+}
+
+static void driver(void){
+	uint i, n;
+	printf("op,tasks,samples,min,median,p99,max,unit\n");
+
+	spawn(ping, EARLY);
+	spawn(pong, EARLY + 1);
+	go(2);
+	report("pingpong", 2);
+
+	spawn(flip, EARLY);
+	spawn(flip, EARLY + 1);
+	go(2);
+	report("deadline", 2);
+
+	spawn(spawner, EARLY);
+	go(1);
+	report("create", 1);
+
+	for(i = 0; i < sizeof(nFillers) / sizeof(nFillers[0]); i++){
+		if(nFillers[i] + 3 > MAX_TASKS) break; //Idle, driver and sleeper
+		spawn(sleeper, EARLY);
+		for(n = 0; n < nFillers[i]; n++)
+			spawn(filler, EARLY + 10);
+		go(nFillers[i] + 1);
+		report("wakeup", nFillers[i]);
+	}
+	fflush(stdout);
+	exit(0);
+}
+
+int main(void)
+{
+	if(init_kernel() != OK) return 1;
+	mbGo = create_mailbox(MAX_TASKS, sizeof(int)); //Room for every waiting task
+	mbDone = create_mailbox(1, sizeof(int));
+	mbPing = create_mailbox(1, sizeof(int));
+	mbPong = create_mailbox(1, sizeof(int));
+	if(!mbGo || !mbDone || !mbPing || !mbPong) return 1;
+	if(create_task(driver, DRIVER) != OK) return 1;
+	run();
+	return 0;
+}
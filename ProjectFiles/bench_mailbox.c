@@ -0,0 +1,110 @@
+/* bench_mailbox.c
+ * Host throughput of send_no_wait/receive_no_wait for the linked
+ * mailbox of create_mailbox() and the ring of create_ring_mailbox(),
+ * and of passing buffers through create_buffer_mailbox().
+ * Build, e.g.
+ *   gcc -O2 -DHEAP_SIZE=262144 -o bench_mailbox bench_mailbox.c kernel.c readyq.c twheel.c pool.c tlsf.c host_stubs.c
+ * The mailbox is filled with BURST Messages and then emptied, for
+ * several data sizes. Reports nanoseconds per Message, one send plus
+ * one receive, and the overwrite case where every send drops the
+ * oldest Message of a full mailbox. A buffer Message includes
+ * create_buffer() and release_buffer(). The second table is the cost
+ * per Message of send_no_wait_n/receive_no_wait_n against the number
+ * of Messages per call, 1 being the single calls.
+ */
+#include "kernel.h"
+#include <stdio.h>
+#include <time.h>
+
+#define BURST           8
+#define ROUNDS          200000
+
+static const uint nSizes[] = {4, 64, 256, 1024, 4096};
+static char data[4096];
+
+static void body(void){}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double fifo(mailbox* mb){
+	uint r, i;
+	double t0 = now_ns();
+	for(r = 0; r < ROUNDS; r++){
+		for(i = 0; i < BURST; i++) send_no_wait(mb, data);
+		for(i = 0; i < BURST; i++) receive_no_wait(mb, data);
+	}
+	return (now_ns() - t0) / ROUNDS / BURST;
+}
+
+static double buffers(mailbox* mb, uint nSize){
+	uint r, i;
+	void* p;
+	double t0 = now_ns();
+	for(r = 0; r < ROUNDS; r++){
+		for(i = 0; i < BURST; i++) send_buffer(mb, create_buffer(nSize));
+		for(i = 0; i < BURST; i++){
+			receive_no_wait(mb, &p);
+			release_buffer(p);
+		}
+	}
+	return (now_ns() - t0) / ROUNDS / BURST;
+}
+
+static double batch(mailbox* mb, uint nBatch){
+	uint r;
+	double t0 = now_ns();
+	for(r = 0; r < ROUNDS * BURST / nBatch; r++){
+		if(nBatch == 1){
+			send_no_wait(mb, data);
+			receive_no_wait(mb, data);
+		}else{
+			send_no_wait_n(mb, data, nBatch);
+			receive_no_wait_n(mb, data, nBatch);
+		}
+	}
+	return (now_ns() - t0) / ROUNDS / BURST;
+}
+
+static double overwrite(mailbox* mb){
+	uint r, i;
+	double t0;
+	for(i = 0; i < BURST; i++) send_no_wait(mb, data);
+	t0 = now_ns();
+	for(r = 0; r < ROUNDS * BURST; r++) send_no_wait(mb, data);
+	t0 = (now_ns() - t0) / ROUNDS / BURST;
+	for(i = 0; i < BURST; i++) receive_no_wait(mb, data);
+	return t0;
+}
+
+int main(void){
+	uint i;
+	init_kernel();
+	create_task(body, 100);
+	run();
+	printf("%8s %12s %12s %12s %12s %12s\n", "bytes", "list ns", "ring ns", "buffer ns", "list ovw ns", "ring ovw ns");
+	for(i = 0; i < sizeof(nSizes) / sizeof(nSizes[0]); i++){
+		mailbox* pList = create_mailbox(BURST, nSizes[i]);
+		mailbox* pRing = create_ring_mailbox(BURST, nSizes[i]);
+		mailbox* pBuf = create_buffer_mailbox(BURST);
+		double a = fifo(pList), b = fifo(pRing), e = buffers(pBuf, nSizes[i]);
+		double c = overwrite(pList), d = overwrite(pRing);
+		printf("%8u %12.1f %12.1f %12.1f %12.1f %12.1f\n", nSizes[i], a, b, e, c, d);
+		no_messages(pList);
+		no_messages(pRing);
+		no_messages(pBuf);
+	}
+	printf("\n%8s %12s %12s\n", "batch", "list ns", "ring ns");
+	for(i = 1; i <= 16; i *= 2){
+		mailbox* pList = create_mailbox(16, 16);
+		mailbox* pRing = create_ring_mailbox(16, 16);
+		double a = batch(pList, i), b = batch(pRing, i);
+		printf("%8u %12.1f %12.1f\n", i, a, b);
+		no_messages(pList);
+		no_messages(pRing);
+	}
+	return 0;
+}
@@ -0,0 +1,128 @@
+/* bench_readyq.c
+ * Host benchmark of the deadline queue backends in readyq.c.
+ * Build one binary per backend, e.g.
+ *   gcc -O2 -DREADYQ=READYQ_LIST   -o bench_list   bench_readyq.c readyq.c
+ *   gcc -O2 -DREADYQ=READYQ_HEAP   -o bench_heap   bench_readyq.c readyq.c
+ *   gcc -O2 -DREADYQ=READYQ_BITMAP -o bench_bitmap bench_readyq.c readyq.c
+ * For every queue size N the queue is filled with N tasks and then
+ * exercised with the hold model the kernel produces: extract the
+ * earliest deadline and insert it again with a later deadline.
+ * The drain workload keeps the idle task (deadline UINT_MAX) queued,
+ * releases N tasks and runs them until only idle is left, as the
+ * Readylist does between bursts. For READYQ_BITMAP this is the case
+ * that lowers the window under idle and refills it from the overflow
+ * list on every burst.
+ * Reported times are nanoseconds per insert and per extract-min.
+ */
+#include "readyq.h"
+#include <stdio.h>
+#include <time.h>
+#include <assert.h>
+#include <limits.h>
+
+#define HOLD_OPS        200000
+
+static const uint nSizes[] = {10, 100, 1000, 10000};
+
+static unsigned long seed = 1;
+static uint rnd(uint range){
+	seed = seed * 1103515245UL + 12345UL;
+	return (uint)((seed >> 8) % range);
+}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench(uint n){
+	readyq* q = create_readyq(n);
+	TCB* tasks = (TCB*)calloc(n, sizeof(TCB));
+	listobj* objs = (listobj*)calloc(n, sizeof(listobj));
+	double t0, tIns = 0, tExt = 0;
+	uint i, last = 0, tick = 0;
+	assert(q && tasks && objs);
+
+	t0 = now_ns();
+	for(i = 0; i < n; i++){
+		tasks[i].DeadLine = rnd(4 * n);
+		objs[i].pTask = &tasks[i];
+		rq_insertObj(q, &objs[i]);
+	}
+	tIns += now_ns() - t0;
+
+	for(i = 0; i < HOLD_OPS; i++){
+		listobj* pObj;
+		t0 = now_ns();
+		pObj = rq_first(q);
+		rq_extractObj(q, pObj);
+		tExt += now_ns() - t0;
+		assert(pObj->pTask->DeadLine >= last); //EDF order kept
+		last = tick = pObj->pTask->DeadLine;
+		pObj->pTask->DeadLine = tick + 1 + rnd(4 * n);
+		t0 = now_ns();
+		rq_insertObj(q, pObj);
+		tIns += now_ns() - t0;
+	}
+	printf("%8u %14.1f %14.1f\n", n, tIns / (n + HOLD_OPS), tExt / HOLD_OPS);
+
+	deleteReadyq(q);
+	free(tasks);
+	free(objs);
+}
+
+static void drain(uint n){
+	readyq* q = create_readyq(n + 1);
+	TCB* tasks = (TCB*)calloc(n + 1, sizeof(TCB));
+	listobj* objs = (listobj*)calloc(n + 1, sizeof(listobj));
+	listobj* pIdle = &objs[n];
+	double t0, tIns = 0, tExt = 0;
+	uint i, r, nRounds = HOLD_OPS / n, tick = 0;
+	assert(q && tasks && objs);
+
+	tasks[n].DeadLine = UINT_MAX;
+	pIdle->pTask = &tasks[n];
+	rq_insertObj(q, pIdle);
+	for(r = 0; r < nRounds; r++){
+		uint last = tick;
+		t0 = now_ns();
+		for(i = 0; i < n; i++){
+			tasks[i].DeadLine = tick + 1 + rnd(4 * n);
+			objs[i].pTask = &tasks[i];
+			rq_insertObj(q, &objs[i]);
+		}
+		tIns += now_ns() - t0;
+		for(;;){
+			listobj* pObj;
+			t0 = now_ns();
+			pObj = rq_first(q);
+			if(pObj == pIdle){ //Drained to idle
+				tExt += now_ns() - t0;
+				break;
+			}
+			rq_extractObj(q, pObj);
+			tExt += now_ns() - t0;
+			assert(pObj->pTask->DeadLine >= last); //EDF order kept
+			last = tick = pObj->pTask->DeadLine;
+		}
+	}
+	printf("%8u %14.1f %14.1f\n", n, tIns / (n * nRounds),
+		tExt / ((n + 1) * nRounds));
+
+	deleteReadyq(q);
+	free(tasks);
+	free(objs);
+}
+
+int main(void){
+	uint i;
+	printf("backend READYQ=%d\n", READYQ);
+	printf("hold\n%8s %14s %14s\n", "tasks", "insert ns", "extract ns");
+	for(i = 0; i < sizeof(nSizes) / sizeof(nSizes[0]); i++)
+		bench(nSizes[i]);
+	printf("drain to idle\n%8s %14s %14s\n", "tasks", "insert ns", "extract ns");
+	for(i = 0; i < sizeof(nSizes) / sizeof(nSizes[0]); i++)
+		drain(nSizes[i]);
+	return 0;
+}
@@ -0,0 +1,109 @@
+/* bench_switch.c
+ * Host cost of the calls that may or may not switch task, in the common
+ * case where the calling task stays first in the Readylist and in the
+ * case where it does not.
+ * Build, e.g.
+ *   gcc -O2 -o bench_switch bench_switch.c kernel.c readyq.c twheel.c pool.c tlsf.c host_stubs.c
+ * The context stubs copy the words context.s79 moves: 17 for
+ * SaveContext and LoadContext, 11 for SwitchContext. A switch then
+ * costs about what the kernel does around it on the target, but not
+ * the target's memory timing. Reports nanoseconds and, on x86, TSC
+ * cycles per call:
+ *   poll miss    receive_no_wait on an empty mailbox
+ *   poll hit     send_no_wait + receive_no_wait of one ring Message
+ *   deadline     set_deadline that keeps the task first
+ *   switch       set_deadline that hands over to the other task,
+ *                the voluntary SwitchContext path
+ *   preempt      the timer interrupt path, SaveContext, TimerInt()
+ *                and LoadContext
+ */
+#include "kernel.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES()        __rdtsc()
+#else
+#define CYCLES()        0
+#endif
+
+#define CALLS           2000000
+
+extern TCB* Running;
+
+void TimerInt(void);
+void RunningContext(void);
+
+static uint regs[CONTEXT_SIZE + 4];
+
+void SaveContext(void){ memcpy(Running->Context, regs, sizeof(regs)); }
+void LoadContext(void){ memcpy(regs, Running->Context, sizeof(regs)); }
+void SwitchContext(void){
+	memcpy(&Running->Context[4], &regs[4], 8 * sizeof(uint));
+	memcpy(&Running->SP, &regs[CONTEXT_SIZE], 3 * sizeof(uint));
+	RunningContext();
+}
+
+static mailbox* pBox;
+static mailbox* pRing;
+static uint nDeadline;
+
+static void body(void){}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void poll_miss(void){
+	int x;
+	receive_no_wait(pBox, &x);
+}
+
+static void poll_hit(void){
+	int x = 1;
+	send_no_wait(pRing, &x);
+	receive_no_wait(pRing, &x);
+}
+
+static void keep_first(void){
+	set_deadline(++nDeadline & 1 ? 1000 : 1001);
+}
+
+static void hand_over(void){
+	set_deadline(nDeadline += 10); // Later than the other task
+}
+
+static void preempt(void){
+	SaveContext();
+	TimerInt();
+	LoadContext();
+}
+
+static void measure(const char* pName, void (*call)(void)){
+	uint i;
+	double t0 = now_ns();
+	unsigned long long c0 = CYCLES();
+	for(i = 0; i < CALLS; i++) call();
+	c0 = CYCLES() - c0;
+	printf("%-12s %10.1f %10.1f\n", pName, (now_ns() - t0) / CALLS, (double)c0 / CALLS);
+}
+
+int main(void){
+	init_kernel();
+	create_task(body, 100000);
+	create_task(body, 200000);
+	run();
+	pBox = create_mailbox(4, sizeof(int));
+	pRing = create_ring_mailbox(4, sizeof(int));
+	printf("%-12s %10s %10s\n", "case", "ns", "cycles");
+	measure("poll miss", poll_miss);
+	measure("poll hit", poll_hit);
+	measure("deadline", keep_first);
+	nDeadline = 300000;
+	measure("switch", hand_over);
+	measure("preempt", preempt);
+	return 0;
+}
@@ -0,0 +1,123 @@
+/* bench_tick.c
+ * Host measurement of the tick ISR, TimerInt(), with N periodic tasks.
+ * Tasks have periods of 10, 20, 50 and 100 ticks so many of them are
+ * released on the same tick. After each tick the released tasks are
+ * armed again, as if they had called wait(), and the cost of that
+ * Timerlist insert is reported separately.
+ * Build, e.g.
+ *   gcc -O2 -DMAX_TASKS=1001 -o bench_tick bench_tick.c kernel.c readyq.c twheel.c pool.c tlsf.c host_stubs.c
+ * Reports mean, 99th percentile and worst-case nanoseconds per
+ * TimerInt() call. The worst case on a desktop host includes OS noise,
+ * the 99th percentile is the more stable number to compare. The time
+ * of each call with interrupts off, up to its first isr_on() and from
+ * its last isr_off(), is reported the same way. It is the whole call
+ * unless built with SOFTIRQ, as host/bench_softirq is.
+ */
+#include "kernel.h"
+#include <stdio.h>
+#include <time.h>
+
+#define WARMUP          1000
+#define TICKS           20000
+
+extern struct threeLists{
+	list* waiting;
+	list* ready;
+	list* timer;
+}List;
+
+void TimerInt(void);
+listobj* extract(listobj* pObj);
+void insert(list* mylist, listobj* pObj);
+listobj* first(list* mylist);
+
+static int bTimed; //In a measured TimerInt()
+static double tOff, offTime;
+static double now_ns(void);
+
+void isr_off(void){ if(bTimed) tOff = now_ns(); }
+void isr_on(void){ if(bTimed) offTime += now_ns() - tOff; }
+
+static const uint nPeriods[] = {10, 20, 50, 100};
+static const uint nSizes[] = {10, 100, 1000};
+
+static listobj* objs[MAX_TASKS];
+static uint period[MAX_TASKS];
+static double sample[TICKS];
+static double offSample[TICKS];
+
+static void body(void){}
+
+static int cmp(const void* a, const void* b){
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static double now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void arm(uint i){
+	objs[i]->nTCnt += period[i];
+	objs[i]->pTask->DeadLine = objs[i]->nTCnt + period[i];
+	insert(List.timer, objs[i]);
+}
+
+static void bench(uint n){
+	uint i, t, nArms = 0;
+	double t0, dt, sum = 0, worst = 0, armed = 0, offSum = 0;
+	init_kernel();
+	for(i = 0; i < n; i++)
+		create_task(body, 1);
+	for(i = 0; i < n; i++){ //Move everything but idle to the Timerlist
+		objs[i] = extract(first(List.ready));
+		period[i] = nPeriods[i % 4];
+		objs[i]->nTCnt = i % 4;
+		arm(i);
+	}
+	for(t = 0; t < WARMUP + TICKS; t++){
+		offTime = 0;
+		bTimed = 1;
+		t0 = tOff = now_ns(); //Entered with interrupts off
+		TimerInt();
+		dt = now_ns() - t0;
+		offTime += now_ns() - tOff;
+		bTimed = 0;
+		if(t >= WARMUP){
+			sample[t - WARMUP] = dt;
+			offSample[t - WARMUP] = offTime;
+			sum += dt;
+			offSum += offTime;
+			if(dt > worst) worst = dt;
+		}
+		for(i = 0; i < n; i++){
+			if(objs[i]->pList == List.ready){
+				extract(objs[i]);
+				t0 = now_ns();
+				arm(i);
+				armed += now_ns() - t0;
+				nArms++;
+			}
+		}
+	}
+	qsort(sample, TICKS, sizeof(double), cmp);
+	qsort(offSample, TICKS, sizeof(double), cmp);
+	printf("%8u %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f %12.1f\n", n, sum / TICKS, sample[TICKS * 99 / 100],
+	       worst, armed / nArms, offSum / TICKS, offSample[TICKS * 99 / 100], offSample[TICKS - 1]);
+}
+
+int main(void){
+	uint i;
+#ifdef SOFTIRQ
+	printf("READYQ=%d SOFTIRQ\n", READYQ);
+#else
+	printf("READYQ=%d\n", READYQ);
+#endif
+	printf("%8s %12s %12s %12s %12s %12s %12s %12s\n", "tasks", "mean ns", "p99 ns", "worst ns", "arm ns",
+	       "off mean ns", "off p99 ns", "off worst");
+	for(i = 0; i < sizeof(nSizes) / sizeof(nSizes[0]); i++)
+		if(nSizes[i] < MAX_TASKS) bench(nSizes[i]);
+	return 0;
+}
@@ -0,0 +1,273 @@
+// gedf.c
+// Global EDF on the Linux host: nCores POSIX threads are the cores and
+// between them always run the nCores earliest deadline tasks. A task is
+// a ucontext with a stack of its own and may resume on any core.
+// This is a model of the dispatch rule, not a mode of kernel.c: the
+// kernel keeps one Running and one Readylist guarded by isr_off() and
+// runs on one core. Only readyq.c is shared with it.
+//
+// The ready tasks are one readyq, the Readylist backend, shared by all
+// cores under a spinlock. A core that finds it empty spins on it
+// without the lock. When tasks become ready with earlier deadlines
+// than running ones, each one not taken by an idle core gets its own
+// preemption request, to the core running the latest deadline that
+// has not been asked yet: its bPreempt is set. The task takes it at
+// its next preemption point, gedf_poll() or the end of gedf_create(),
+// by switching to the core's scheduler, which puts the task back in
+// the queue and loads the first one.
+//
+// There is no interprocessor interrupt: a switch made from a signal
+// handler would not be async-signal-safe. So a task only leaves its
+// core at a preemption point, and a task that does not poll keeps its
+// core until it returns. A request the task answers by returning is
+// cleared by the next dispatch on its core.
+
+#define _GNU_SOURCE
+#include "gedf.h"
+#include "readyq.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+typedef struct gtask {
+	TCB             Tcb;            // DeadLine and the readyq item, first
+	ucontext_t      Ctx;
+	void            (*pBody)(void*);
+	void            *pArg;
+	char            *pStack;
+	uint            nCore;          // Core it last ran on, GEDF_MAX_CORES if none
+	bool            bDone;          // Body has returned
+} gtask;
+
+typedef struct {
+	pthread_t       Thread;
+	ucontext_t      Sched;          // The core's scheduler loop
+	gtask           *pRunning;      // NULL if idle
+	volatile uint   bPreempt;       // Preemption request outstanding
+} gcore;
+
+static gcore Cores[GEDF_MAX_CORES];
+static uint nCores;
+static readyq* pReady;
+static volatile uint nReady;            // Read without the lock by idle cores
+static volatile uint nLive;             // Tasks not yet returned
+static uint nPending;                   // Cores with bPreempt set
+static gedfstat Stat;
+static volatile char Lock;
+
+static void lock(void){
+	while(__atomic_test_and_set(&Lock, __ATOMIC_ACQUIRE)){
+		uint nSpins = 0;
+		while(Lock)
+			if(++nSpins % 64 == 0) sched_yield(); //Holder may be off the CPU
+	}
+}
+
+static void unlock(void){
+	__atomic_clear(&Lock, __ATOMIC_RELEASE);
+}
+
+static pthread_t (*volatile pSelf)(void) = pthread_self;
+
+static gcore* this_core(void){
+	//pthread_self() is read anew on each call, a task may have moved
+	//at its last preemption point. It is called through a volatile
+	//pointer: it is declared const, and the compiler would reuse the
+	//thread of the first call across a switch to another core.
+	uint i;
+	pthread_t Self = pSelf();
+	for(i = 0; i < nCores; i++)
+		if(pthread_equal(Cores[i].Thread, Self)) return &Cores[i];
+	return NULL; //Not a core, gedf_run() not started
+}
+
+static listobj* nth_ready(uint n){
+	//Lock held. The ready task n places after the first, NULL if
+	//fewer are ready. Takes them out and puts them back, the last
+	//first so that equal deadlines keep their order.
+	listobj* Taken[GEDF_MAX_CORES];
+	listobj* pObj = NULL;
+	uint k = 0;
+	while(k <= n && (pObj = rq_first(pReady))){
+		rq_extractObj(pReady, pObj);
+		Taken[k++] = pObj;
+	}
+	pObj = k > n ? Taken[n] : NULL;
+	while(k) rq_insertObj(pReady, Taken[--k]);
+	return pObj;
+}
+
+static void kick(void){
+	//Lock held. Ask cores to give way until the nCores earliest tasks
+	//run or are about to: the first ready tasks go to idle cores and
+	//to the outstanding requests, each further one that is earlier
+	//than a running task asks the core with the latest deadline not
+	//asked yet.
+	uint nCovered = nPending;
+	uint i;
+	for(i = 0; i < nCores; i++)
+		if(!Cores[i].pRunning) nCovered++;
+	while(nCovered < nCores){
+		listobj* pNext = nth_ready(nCovered);
+		gcore* pVictim = NULL;
+		if(!pNext) return;
+		for(i = 0; i < nCores; i++){
+			gcore* pCore = &Cores[i];
+			if(!pCore->pRunning || pCore->bPreempt) continue;
+			if(!pVictim || pCore->pRunning->Tcb.DeadLine > pVictim->pRunning->Tcb.DeadLine)
+				pVictim = pCore;
+		}
+		if(!pVictim || pVictim->pRunning->Tcb.DeadLine <= pNext->pTask->DeadLine) return;
+		pVictim->bPreempt = TRUE;
+		nPending++;
+		nCovered++;
+		Stat.nRequests++;
+	}
+}
+
+static void task_entry(void){
+	gtask* pTask = this_core()->pRunning;
+	pTask->pBody(pTask->pArg);
+	pTask->bDone = TRUE;
+	setcontext(&this_core()->Sched); //The core it returned on
+}
+
+static void* core_main(void* p){
+	gcore* pCore = (gcore*)p;
+	uint nCore = pCore - Cores;
+	lock();
+	while(nLive){
+		listobj* pObj = rq_first(pReady);
+		gtask* pTask;
+		if(!pObj){ //Idle until a task is ready
+			unlock();
+			while(!nReady && nLive)
+				sched_yield();
+			lock();
+			continue;
+		}
+		rq_extractObj(pReady, pObj);
+		nReady--;
+		pTask = (gtask*)pObj->pTask;
+		if(pTask->nCore != nCore && pTask->nCore != GEDF_MAX_CORES) Stat.nMigrations++;
+		Stat.nDispatches++;
+		pCore->pRunning = pTask;
+		if(pCore->bPreempt){ //Answered by this dispatch
+			pCore->bPreempt = FALSE;
+			nPending--;
+		}
+		kick();
+		unlock();
+		swapcontext(&pCore->Sched, &pTask->Ctx);
+		lock();
+		pCore->pRunning = NULL;
+		pTask->nCore = nCore;
+		if(pTask->bDone){
+			nLive--;
+			free(pTask->pStack);
+			free(pTask);
+		}else{
+			Stat.nPreemptions++;
+			rq_insertObj(pReady, &pTask->Tcb.Node);
+			nReady++;
+		}
+	}
+	unlock();
+	return NULL;
+}
+
+exception gedf_init(uint nCores_){
+	//Global EDF on nCores cores, no tasks yet
+	if(nCores_ == 0 || nCores_ > GEDF_MAX_CORES) return FAIL;
+	if(pReady) deleteReadyq(pReady);
+	pReady = create_readyq(GEDF_MAX_TASKS);
+	if(!pReady) return FAIL;
+	nCores = nCores_;
+	nReady = nLive = nPending = 0;
+	memset(&Stat, 0, sizeof(Stat));
+	return OK;
+}
+
+exception gedf_create(void (*body)(void*), void* pArg, uint nDeadline){
+	//A task ready at once with an absolute deadline, it may preempt
+	//a running task, the calling one too: the call ends with a
+	//preemption point. Before or during gedf_run().
+	gtask* pTask = (gtask*)calloc(1, sizeof(gtask));
+	if(pTask) pTask->pStack = (char*)malloc(GEDF_STACK_SIZE);
+	if(!pTask || !pTask->pStack || getcontext(&pTask->Ctx)){
+		if(pTask) free(pTask->pStack);
+		free(pTask);
+		return FAIL;
+	}
+	pTask->Ctx.uc_stack.ss_sp = pTask->pStack;
+	pTask->Ctx.uc_stack.ss_size = GEDF_STACK_SIZE;
+	pTask->Ctx.uc_link = NULL;
+	makecontext(&pTask->Ctx, task_entry, 0);
+	pTask->pBody = body;
+	pTask->pArg = pArg;
+	pTask->nCore = GEDF_MAX_CORES;
+	pTask->Tcb.DeadLine = nDeadline;
+	pTask->Tcb.Node.pTask = &pTask->Tcb;
+	lock();
+	if(nLive == GEDF_MAX_TASKS){
+		unlock();
+		free(pTask->pStack);
+		free(pTask);
+		return FAIL;
+	}
+	nLive++;
+	rq_insertObj(pReady, &pTask->Tcb.Node);
+	nReady++;
+	kick();
+	unlock();
+	gedf_poll();
+	return OK;
+}
+
+void gedf_poll(void){
+	//Preemption point of the calling task: if its core was asked to
+	//give way, back to the core's scheduler. Returns when the task
+	//is loaded again, maybe on another core. No-op outside a task.
+	gcore* pCore = this_core();
+	if(!pCore || !pCore->bPreempt || !pCore->pRunning) return;
+	swapcontext(&pCore->pRunning->Ctx, &pCore->Sched);
+}
+
+void gedf_run(void){
+	//Start the cores, returns when every task has returned
+	uint i;
+	for(i = 0; i < nCores; i++){
+		Cores[i].pRunning = NULL;
+		Cores[i].bPreempt = FALSE;
+	}
+	lock(); //this_core() needs all threads in Cores
+	for(i = 0; i < nCores; i++)
+		pthread_create(&Cores[i].Thread, NULL, core_main, &Cores[i]);
+	unlock();
+	for(i = 0; i < nCores; i++)
+		pthread_join(Cores[i].Thread, NULL);
+}
+
+uint gedf_core(void){
+	//Core of the calling task, it may move at any time
+	gcore* pCore = this_core();
+	return pCore ? (uint)(pCore - Cores) : GEDF_MAX_CORES;
+}
+
+void gedf_running(uint* pDeadlines){
+	//Deadline of the task on each core, UINT_MAX if idle, as one
+	//snapshot
+	uint i;
+	lock();
+	for(i = 0; i < nCores; i++)
+		pDeadlines[i] = Cores[i].pRunning ? Cores[i].pRunning->Tcb.DeadLine : 0xffffffff;
+	unlock();
+}
+
+void gedf_stats(gedfstat* pStat){
+	lock();
+	*pStat = Stat;
+	unlock();
+}
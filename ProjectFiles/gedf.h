@@ -0,0 +1,32 @@
+#ifndef GEDF_H
+#define GEDF_H
+
+#include "kernel.h"
+
+/*********************************************************/
+/** Global EDF model over host threads, not kernel.c     */
+/*********************************************************/
+
+#define GEDF_MAX_CORES  8
+#define GEDF_MAX_TASKS  256
+#ifndef GEDF_STACK_SIZE
+#define GEDF_STACK_SIZE 65536           // Bytes per task
+#endif
+
+// Scheduler counters, see gedf_stats()
+typedef struct {
+        uint            nDispatches;    // Tasks loaded by a core
+        uint            nPreemptions;   // Tasks switched away from before they returned
+        uint            nMigrations;    // Tasks resumed on another core than they left
+        uint            nRequests;      // Preemption requests to a running core
+} gedfstat;
+
+exception       gedf_init( uint nCores );
+exception       gedf_create( void (*body)(void*), void* pArg, uint nDeadline );
+void            gedf_run( void );
+void            gedf_poll( void );
+uint            gedf_core( void );
+void            gedf_running( uint* pDeadlines );
+void            gedf_stats( gedfstat* pStat );
+
+#endif
@@ -0,0 +1,24 @@
+/* host_stubs.c
+ * Port stubs for the host programs that drive the kernel themselves,
+ * see the Makefile. Nothing is saved or loaded: SwitchContext()
+ * dispatches the next task and returns to the caller, which then acts
+ * as that task. Interrupts are never taken and timer0_stamp() is the
+ * tick counter. Each stub is weak, a program that needs its own, e.g.
+ * a clock it steps, defines it and the linker takes that one.
+ */
+#include "kernel.h"
+#include "kernel_hwdep.h"
+
+#define STUB    __attribute__((weak))
+
+void RunningContext(void);
+
+STUB void isr_off(void){}
+STUB void isr_on(void){}
+STUB void SaveContext(void){}
+STUB void LoadContext(void){}
+STUB void SwitchContext(void){ RunningContext(); }
+STUB void timer0_start(void){}
+STUB uint timer0_stamp(uint nTicks){ return nTicks; }
+STUB uint timer0_count(void){ return 0; }
+STUB uint timer0_tick_counts(void){ return 1; }
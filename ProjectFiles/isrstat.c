@@ -0,0 +1,89 @@
+#include "isrstat.h"
+#include "kernel_hwdep.h"
+#include <string.h>
+
+/*********************************************************/
+/** Interrupts-off windows                               */
+/*********************************************************/
+
+// Built with ISR_STATS kernel.c calls isr_stat_off() and isr_stat_on()
+// in place of isr_off() and isr_on(). The name given is that of the
+// public call the application made, helpers pass it down. The first
+// call to turn interrupts off owns the window, further isr_off() calls
+// inside it are not windows of their own. Sites are found by the
+// address of their name, a linear search over the few kernel calls
+// that disable interrupts.
+
+#ifdef ISR_STATS
+
+extern uint tickCounter;
+
+static isrsite Sites[ISR_SITES];
+static uint nSites;
+static isrsite* pOpen;          // Site of the open window, NULL if interrupts are on
+static uint nStart;             // timer0_stamp() when it opened
+
+static isrsite* site(const char* pName){
+	uint i;
+	for(i = 0; i < nSites; i++)
+		if(Sites[i].pName == pName) return &Sites[i];
+	if(nSites == ISR_SITES) return &Sites[ISR_SITES - 1]; //Full, the last one takes the rest
+	Sites[nSites].pName = pName;
+	return &Sites[nSites++];
+}
+
+void isr_stat_begin(const char* pName){
+	//Interrupts are off, open a window unless one is open
+	if(pOpen) return;
+	pOpen = site(pName);
+	nStart = timer0_stamp(tickCounter);
+}
+
+void isr_stat_end(void){
+	//Interrupts go on, close the open window
+	uint nTime, b = 0;
+	isrsite* pSite = pOpen;
+	if(!pSite) return;
+	nTime = timer0_stamp(tickCounter) - nStart;
+	pOpen = NULL;
+	pSite->nCount++;
+	pSite->nTotal += nTime;
+	if(nTime > pSite->nMax) pSite->nMax = nTime;
+	while(nTime){ //b = floor(log2(nTime)) + 1
+		nTime >>= 1;
+		b++;
+	}
+	pSite->Hist[b < ISR_BUCKETS ? b : ISR_BUCKETS - 1]++;
+}
+
+void isr_stat_off(const char* pName){
+	isr_off();
+	isr_stat_begin(pName);
+}
+
+void isr_stat_on(void){
+	isr_stat_end();
+	isr_on();
+}
+
+uint isr_stats(isrsite* pSites, uint nMax){
+	//Copy up to nMax sites, in the order they were first seen.
+	//Returns the number copied.
+	uint n;
+	isr_off();
+	n = nSites < nMax ? nSites : nMax;
+	memcpy(pSites, Sites, n * sizeof(isrsite));
+	isr_on();
+	return n;
+}
+
+void isr_stats_reset(void){
+	//Forget all windows, the one open now is not counted
+	isr_off();
+	memset(Sites, 0, sizeof(Sites));
+	nSites = 0;
+	pOpen = NULL;
+	isr_on();
+}
+
+#endif
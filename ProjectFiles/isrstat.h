@@ -0,0 +1,42 @@
+#ifndef ISRSTAT_H
+#define ISRSTAT_H
+
+#include "kernel.h"
+
+/*********************************************************/
+/** Interrupts-off windows, compiled in with ISR_STATS   */
+/*********************************************************/
+
+#ifndef ISR_SITES
+#define ISR_SITES       48      // Kernel calls that disable interrupts
+#endif
+#define ISR_BUCKETS     32      // Bucket b > 0: windows of 2^(b-1) to 2^b - 1 counts
+
+// The windows one kernel call opened, in timer0_stamp() counts. A
+// window runs from the isr_off() that turned interrupts off, or the
+// entry of TimerInt() or isr_exit(), to the isr_on() or task load that
+// turned them on again.
+typedef struct {
+        const char      *pName;         // Public kernel call, or TimerInt, isr_exit
+        uint            nCount;
+        uint            nMax;
+        unsigned long long nTotal;
+        uint            Hist[ISR_BUCKETS];      // Bucket 0: empty windows
+} isrsite;
+
+uint            isr_stats( isrsite* pSites, uint nSites );
+void            isr_stats_reset( void );
+void            isr_stat_off( const char* pName );
+void            isr_stat_on( void );
+void            isr_stat_begin( const char* pName );
+void            isr_stat_end( void );
+
+#ifdef ISR_STATS
+#define ISR_STAT_BEGIN(name)    isr_stat_begin(name)
+#define ISR_STAT_END()          isr_stat_end()
+#else
+#define ISR_STAT_BEGIN(name)    ((void)0)
+#define ISR_STAT_END()          ((void)0)
+#endif
+
+#endif
@@ -1,23 +1,58 @@
 #include "kernel.h"
+#include "readyq.h"
+#include "twheel.h"
+#include "pool.h"
+#include "tlsf.h"
+#include "trace.h"
+#include "isrstat.h"
+#include "kernel_hwdep.h"
 #include "stdio.h"
 #include "stdlib.h"
 #include <string.h>
 #include <limits.h>
 
 void idle(void);
-list* create_List(void);
-listobj* create_Listobj(TCB* task);
+list* create_DeadlineList(void);
+list* create_TimerList(void);
+TCB* create_TCB(uint nStackSize);
+exception make_task(void(* task_body)(), uint deadline, uint nStackSize, const char* pCall);
+exception start_task(TCB* thisTCB, void(* task_body)(), uint deadline, const char* pCall);
+mailbox* make_mailbox(uint nMessages, uint nDataSize, const char* pCall);
+mailbox* make_ring_mailbox(uint nMessages, uint nDataSize, const char* pCall);
+exception msg_send_wait(mailbox* mBox, void* pData, uint nTicks, const char* pCall);
+exception msg_receive_wait(mailbox* mBox, void* pData, uint nTicks, const char* pCall);
+exception msg_send_no_wait(mailbox* mBox, void* pData, const char* pCall);
+exception admit(void);
+uint demand(uint t);
+unsigned long long utilisation(TCB* pTask);
+uint overloaded(void);
 msg* create_msg(void);
 void insert(list* mylist, listobj* pObj);
+void insertChain(list* mylist, listobj* pFirst);
 listobj* extract(listobj * pObj);
+listobj* first(list* mylist);
 void RunningContext(void);
+void dispatch(TCB* pNext);
+TCB* next_task(void);
+exception block_on(waitq* pQueue, const char* pCall);
+void release(TCB* pTask);
+void wake_deferred(void);
+void tick_work(uint nNow);
+uint* list_ticks(TCB* pTask, list* mylist);
+uint KeepRunning(void);
+void program_shot(void);
 char* create_data(void* data, uint size_t);
 msg *msg_extractObj(mailbox *mBox, msg *specific); 
 exception msg_insertObj(mailbox *mBox, msg *pOb);
+exception msg_put(mailbox *mBox, void *pData);
+void unblock(msg* message);
+void block_msg(listobj* pObj, uint nTicks);
+exception end_msg_wait(mailbox* mBox, uint nTicks, const char* pCall);
+exception msg_get(mailbox *mBox, void *pData);
+void ring_put(mailbox *mBox, void *pData);
+void ring_get(mailbox *mBox, void *pData);
 msg *msg_extractObj(mailbox *mBox, msg *specific);
-TCB* create_TCB(uint deadline, void(*task_body)());
 
-void deleteList(list* obj);
 void deleteListobj(listobj* obj);
 void deleteMailbox(mailbox* mBox);
 void deleteMessage(msg* message);
@@ -30,6 +65,7 @@ void deleteData(char *data);
 
 uint tickCounter;
 TCB* Running;
+uint nShotTicks; //Ticks until the programmed timer interrupt, tickless
 
 struct threeLists{
 	list* waiting;
@@ -37,12 +73,63 @@ struct threeLists{
 	list* timer;
 }List;
 
+pool Pools[NOF_POOLS]; //Kernel objects, indexed by POOL_xxx
+tlsf Heap; //Message data
+char HeapArena[HEAP_SIZE];
+tlsf StackHeap; //Task stacks
+char StackArena[STACK_AREA];
+TCB* Tasks[MAX_TASKS]; //Tasks by nId, NULL if free
+unsigned long long nUtilisation; //Of the periodic tasks, 1 << 32 is the whole CPU
+uint nConstrained; //Periodic tasks with a deadline before the end of the period
+mutex* pLocked; //Locked mutexes, the last locked first
+uint nSystemCeiling; //Shortest nCeiling of the locked mutexes, UINT_MAX if none
+channel* volatile pWakeList; //Channels whose consumer an interrupt handler woke
+#ifdef SOFTIRQ
+uint bSoftIrq; //TimerInt() is walking the lists with interrupts on
+#endif
+
 struct Flags{
 	char startUpMode:1;
 }flag;
 
-void tail(void){}
-void head(void){}
+#ifdef TICKLESS
+//tickCounter is the tick of the last timer interrupt
+#define NOW()   (tickCounter + (flag.startUpMode ? 0 : timer0_elapsed()))
+#else
+#define NOW()   tickCounter
+#endif
+
+#ifdef ISR_STATS
+//Each interrupts-off window is timed and counted for the call that
+//opened it, see isrstat.h. Helpers take the name of the public call
+//they serve, pCall, and disable interrupts with isr_off_in().
+#define isr_off()       isr_stat_off(__func__)
+#define isr_off_in(pCall) isr_stat_off(pCall)
+#define isr_on()        isr_stat_on()
+#else
+#define isr_off_in(pCall) isr_off()
+#endif
+
+#if defined(__GNUC__)
+#define BARRIER()       __asm__ volatile("" ::: "memory")
+#else
+#define BARRIER()       //IAR keeps memory accesses around volatile ones and calls
+#endif
+
+#define ADMIT_LIMIT     (UINT_MAX / 2)  //Longest busy period admit() checks
+#define ADMIT_STEPS     1000            //Passes over Tasks[] admit() makes, interrupts are off
+#define ADMIT_PERIOD    ((unsigned long long)1 << 40)   //Longest common period overloaded() works with
+
+#ifdef TRACE
+static uint trace_list(list* mylist){
+	//TR_xxx_LIST of a kernel list
+	if(mylist == List.ready) return TR_READY_LIST;
+	if(mylist == List.waiting) return TR_WAITING_LIST;
+	if(mylist == List.timer) return TR_TIMER_LIST;
+	return TR_NONE;
+}
+#endif
+
 //void isr_off(){}
 //void isr_on(){}
 /******************************************************************************\
@@ -59,19 +146,46 @@ exception init_kernel(){
 	//Int: Description of the functions status, i.e. FAIL/OK.
 	
 	//Function
+#ifdef TRACE
+	trace_init(); //Empty the trace and start recording
+#endif
 	flag.startUpMode = TRUE; //Set the kernel in start up mode
 	set_ticks(0); //Set tick counter to zero
-	List.ready = create_List();//Create necessary data structures
+	nShotTicks = 1; //timer0_start() interrupts every tick
+	if(pool_init(&Pools[POOL_TCB], sizeof(TCB), MAX_TASKS) != OK) return FAIL;
+	if(pool_init(&Pools[POOL_MSG], sizeof(msg), MAX_MESSAGES) != OK) return FAIL;
+	if(pool_init(&Pools[POOL_MAILBOX], sizeof(mailbox), MAX_MAILBOXES) != OK) return FAIL;
+	if(pool_init(&Pools[POOL_MUTEX], sizeof(mutex), MAX_MUTEXES) != OK) return FAIL;
+	if(pool_init(&Pools[POOL_SEMAPHORE], sizeof(semaphore), MAX_SEMAPHORES) != OK) return FAIL;
+	if(pool_init(&Pools[POOL_EVENT], sizeof(eventgroup), MAX_EVENTS) != OK) return FAIL;
+	if(pool_init(&Pools[POOL_CHANNEL], sizeof(channel), MAX_CHANNELS) != OK) return FAIL;
+	if(tlsf_init(&Heap, HeapArena, HEAP_SIZE) != OK) return FAIL;
+	if(tlsf_init(&StackHeap, StackArena, STACK_AREA) != OK) return FAIL;
+	memset(Tasks, 0, sizeof(Tasks));
+	nUtilisation = 0;
+	nConstrained = 0;
+	pLocked = NULL;
+	nSystemCeiling = UINT_MAX;
+	pWakeList = NULL;
+	List.ready = create_DeadlineList();//Create necessary data structures
 	if(!List.ready) return FAIL; // IF NULL THEN FAIL
-	List.timer = create_List();	
+	List.timer = create_TimerList();	
 	if(!List.timer) return FAIL;
-	List.waiting = create_List();
+	List.waiting = create_DeadlineList();
 	if(!List.waiting) return FAIL;
-	if(!create_task(idle, UINT_MAX)) return FAIL; //Create an idle task
+	if(!make_task(idle, UINT_MAX, IDLE_STACK_SIZE, __func__)) return FAIL; //Create an idle task
 	return OK; //Return status
 }
 
 exception create_task(void(* task_body)(), uint deadline){
+	//This function creates a task with a stack of STACK_SIZE
+	//words, see create_task_stack.
+	
+	//Function
+	return make_task(task_body, deadline, STACK_SIZE, __func__);
+}
+
+exception create_task_stack(void(* task_body)(), uint deadline, uint nStackSize){
 	//This function creates a task. If the call is made in startup
 	//mode, i.e. the kernel is not running, only the
 	//necessary data structures will be created. However, if
@@ -82,28 +196,89 @@ exception create_task(void(* task_body)(), uint deadline){
 	//of the task.
 	//deadline: The kernel will try to schedule the task so it
 	//will meet this deadline.
+	//nStackSize: Words of stack for the task. The stack is
+	//filled with STACK_FILL, see task_stack_usage.
 	//Return parameter
 	//Description of the function?s status, i.e. FAIL/OK.
 	
 	//Function
-	TCB* thisTCB = (TCB*)calloc(1, sizeof(TCB)); //Allocate memory for TCB
+	return make_task(task_body, deadline, nStackSize, __func__);
+}
+
+exception create_periodic_task(void(* task_body)(), uint nWcet, uint nPeriod, uint nDeadline){
+	//This function creates a task as create_task does, that
+	//runs for at most nWcet ticks in every period of nPeriod
+	//ticks and must be done nDeadline ticks into the period.
+	//The first period starts now, see wait_next_period. The
+	//task is only created if EDF can still meet the deadlines of all periodic tasks
+	//with it: their utilisation must stay at most 1, and when
+	//some deadline is before the end of its period the demand
+	//of the tasks is checked at each deadline in the
+	//synchronous busy period (QPA). Tasks from create_task are
+	//not part of the test.
+	//Argument
+	//*task_body: A pointer to the C function holding the code
+	//of the task.
+	//nWcet: Worst case execution time in ticks.
+	//nPeriod: Ticks between the starts of two periods.
+	//nDeadline: Deadline in ticks after the start of a period.
+	//Return parameter
+	//NOT_SCHEDULABLE if the task was rejected by the test,
+	//FAIL if the arguments are wrong or no TCB or stack was
+	//left, OK otherwise.
+	
+	//Function
+	TCB* thisTCB;
+	exception status;
+	if(!nWcet || nWcet > nDeadline || nDeadline > nPeriod) return FAIL;
+	if(!flag.startUpMode) isr_off(); //Tasks[] and the sums kept together
+	thisTCB = create_TCB(STACK_SIZE); //Allocate memory for TCB and stack
+	if(!thisTCB){
+		if(!flag.startUpMode) isr_on();
+		return FAIL;
+	}
+	thisTCB->nWcet = nWcet;
+	thisTCB->nPeriod = nPeriod;
+	thisTCB->nRelDeadline = nDeadline;
+	thisTCB->nRelease = NOW();
+	nUtilisation += utilisation(thisTCB);
+	if(nDeadline < nPeriod) nConstrained++;
+	status = admit();
+	if(status != OK){
+		deleteTCB(thisTCB); //Takes it out of the sums again
+		if(!flag.startUpMode) isr_on();
+		return status;
+	}
+	if(!flag.startUpMode) isr_on();
+	return start_task(thisTCB, task_body, NOW() + nDeadline, __func__);
+}
+
+exception make_task(void(* task_body)(), uint deadline, uint nStackSize, const char* pCall){
+	//create_task_stack for the public call pCall
+	TCB* thisTCB;
+	if(!nStackSize) return FAIL;
+	if(!flag.startUpMode) isr_off_in(pCall); //Pool, stack area and Tasks[] shared with running tasks
+	thisTCB = create_TCB(nStackSize); //Allocate memory for TCB and stack
+	if(!flag.startUpMode) isr_on();
 	if(!thisTCB) return FAIL;
+	return start_task(thisTCB, task_body, deadline, pCall);
+}
+
+exception start_task(TCB* thisTCB, void(* task_body)(), uint deadline, const char* pCall){
+	//Set up a new TCB and make it ready
+	listobj* thisObj = &thisTCB->Node;
 	thisTCB->DeadLine = deadline; //Set deadline in TCB
+	thisTCB->nLevel = deadline - NOW(); //Preemption level, the relative deadline
 	thisTCB->PC = task_body; //Set the TCBs PC to point to the task body
-	thisTCB->SP = &(thisTCB->StackSeg[STACK_SIZE-1]); //Set TCBs SP to point to the stack segment
+	thisTCB->SP = &(thisTCB->pStack[thisTCB->nStackSize-1]); //Set TCBs SP to point to the stack segment
 	
 	if(flag.startUpMode){ //IF start-up mode THEN
-		insert(List.ready,create_Listobj(thisTCB)); //Insert new task in Readylist
+		insert(List.ready,thisObj); //Insert new task in Readylist
 		return OK; //Return status
 	}else {//ELSE
-		volatile uint firstExecution = TRUE;
-		isr_off(); //Disable interrupts
-		SaveContext(); //Save context
-		if(firstExecution){//IF first execution THEN
-			firstExecution = FALSE; //Set: not first execution any more
-			insert(List.ready,create_Listobj(thisTCB)); //Insert new task in Readylist
-			RunningContext(); //Load context
-		} //ENDIF
+		isr_off_in(pCall); //Disable interrupts
+		insert(List.ready,thisObj); //Insert new task in Readylist
+		if(!KeepRunning()) SwitchContext(); //IF new task is first THEN switch to it
 	}//ENDIF
 	return OK; //Return status
 }
@@ -129,8 +304,10 @@ void terminate(void){
 	//another task will be scheduled for execution.
 	
 	//Function
-	if(List.ready->pHead->pNext->pTask->DeadLine != UINT_MAX){
-		deleteListobj(extract(List.ready->pHead->pNext)); //Remove running task from Readylist
+	if(Running->DeadLine != UINT_MAX){
+		isr_off(); //Disable interrupts
+		deleteListobj(extract(&Running->Node)); //Remove running task from Readylist
+		Running = NULL; //Its TCB is gone
 		RunningContext();//Set next task to be the running task
 		//and //Load context
 	}
@@ -148,22 +325,45 @@ mailbox* create_mailbox(uint nMessages, uint nDataSize){
 	//mailbox*: a pointer to the created mailbox or NULL.
 	
 	//Function
-	mailbox* mBox = (mailbox*)calloc(1,sizeof(mailbox)); //Allocate memory for the mailbox
-	if(!mBox) return NULL;
-	mBox->pHead = create_msg(); //Initialize mailbox structure
-	if(!mBox->pHead) {
-		deleteMailbox(mBox);//free(mBox);
-		return NULL;
-	}
-	mBox ->pTail = create_msg();
-	if(!mBox->pTail){ 
-		deleteMailbox(mBox);//free(mBox);
-		//deleteMessage(mBox->pHead);
-		return NULL;
+	return make_mailbox(nMessages, nDataSize, __func__);
+}
+
+mailbox* create_ring_mailbox(uint nMessages, uint nDataSize){
+	//This call will create a mailbox like create_mailbox, with
+	//room for nMessages send_no_wait Messages allocated at once
+	//in one ring buffer. Buffered Messages are then copied in
+	//and out of the ring without allocating a Message struct or
+	//data area. Blocked send_wait and receive_wait calls use
+	//Message structs as in create_mailbox.
+	//Argument
+	//nof_msg: Maximum number of Messages the mailbox can hold.
+	//Size_of msg: The size of one Message in the mailbox.
+	//Return parameter
+	//mailbox*: a pointer to the created mailbox or NULL.
+	
+	//Function
+	return make_ring_mailbox(nMessages, nDataSize, __func__);
+}
+
+mailbox* make_mailbox(uint nMessages, uint nDataSize, const char* pCall){
+	//create_mailbox for the public call pCall
+	mailbox* mBox;
+	if(!flag.startUpMode) isr_off_in(pCall); //Pools shared with running tasks
+	mBox = (mailbox*)pool_alloc(&Pools[POOL_MAILBOX]); //Allocate memory for the mailbox
+	if(mBox){
+		mBox->pHead = create_msg(); //Initialize mailbox structure
+		mBox->pTail = create_msg();
+		if(!mBox->pHead || !mBox->pTail){
+			deleteMailbox(mBox); //Frees the one that was allocated
+			mBox = NULL;
+		}
 	}
+	if(!flag.startUpMode) isr_on();
+	if(!mBox) return NULL;
 	
 	mBox->nMaxMessages = nMessages; 
 	mBox->nDataSize = nDataSize;
+	mBox->nId = pool_index(&Pools[POOL_MAILBOX], mBox);
 	
 	mBox->pHead->pPrevious = mBox->pHead;
 	mBox->pHead->pNext = mBox->pTail;
@@ -173,6 +373,22 @@ mailbox* create_mailbox(uint nMessages, uint nDataSize){
 	return mBox; //Return mailbox*
 }
 
+mailbox* make_ring_mailbox(uint nMessages, uint nDataSize, const char* pCall){
+	//create_ring_mailbox for the public call pCall
+	mailbox* mBox;
+	if(!nMessages) return NULL;
+	mBox = make_mailbox(nMessages, nDataSize, pCall);
+	if(!mBox) return NULL;
+	if(!flag.startUpMode) isr_off_in(pCall); //Heap shared with running tasks
+	mBox->pRing = create_data(NULL, nMessages * nDataSize); //Allocate all slots
+	if(!mBox->pRing){
+		deleteMailbox(mBox);
+		mBox = NULL;
+	}
+	if(!flag.startUpMode) isr_on();
+	return mBox; //Return mailbox*
+}
+
 int no_messages(mailbox *mBox){
 	//This call will remove the mailbox if it is empty and return
 	//OK. Otherwise no action is taken and the call will return
@@ -185,10 +401,13 @@ int no_messages(mailbox *mBox){
 	//it was not empty.
 	
 	//Function
+	if(!flag.startUpMode) isr_off(); //A sender could add a Message meanwhile
 	if(!mBox->nMessages && mBox->pHead->pNext == mBox->pTail){ //IF mailbox is empty THEN
 		deleteMailbox(mBox); //Free the memory for the mailbox
+		if(!flag.startUpMode) isr_on();
 		return OK; //Return OK
 	}else{ //ELSE
+		if(!flag.startUpMode) isr_on();
 		return NOT_EMPTY; //Return NOT_EMPTY
 	}//ENDIF
 }
@@ -214,55 +433,80 @@ exception send_wait( mailbox* mBox, void* pData){
 	//the communicated Message is residing.
 	//Return parameter
 	//exception: The exception return parameter can have
-	//two possible values:
+	//three possible values:
 	// OK: Normal behavior, no exception occurred.
 	// DEADLINE_REACHED: This return parameter
 	//is given if the sending tasks deadline is
 	//reached while it is blocked by the send_wait call.
+	// FAIL: the task could not block, the mailbox
+	//is full of blocked tasks or out of memory.
 	
 	//Function
-	volatile uint firstExecution = TRUE;
-	isr_off(); //Disable interrupt
-	SaveContext(); //Save context
-	
-	if(firstExecution){//IF first execution THEN
-		firstExecution = FALSE; //Set: not first execution any more
-		if(mBox->nBlockedMsg < 0){ //IF receiving task is waiting THEN
-			msg *message;
-			memcpy(mBox->pHead->pNext->pData, pData, mBox->nDataSize); //Copy senders data to the data area of the receivers Message
-			message = msg_extractObj(mBox,NULL); //Remove receiving tasks Message struct from the mailbox
-			insert(List.ready, extract(message->pBlock)); //Move receiving task to Readylist
-			deleteMessage(message);
-		}else{ //ELSE
-			msg* message = create_msg(); //Allocate a Message structure
-			if(!message) return FAIL;
-			
-			message->pData = create_data(pData, mBox->nDataSize); //Copy Data to the Message
-			if(!message->pData){										
-				deleteMessage(message);
-				return FAIL;
-			}
-			//message->pData = pData; //Set data pointer
-			message->Status = 2;
-			msg_insertObj(mBox, message); //Add Message to the mailbox
-			insert(List.waiting, extract(List.ready->pHead->pNext)); //Move sending task from Readylist to Waitinglist
-		}//ENDIF
-		RunningContext(); //Load context
+	return msg_send_wait(mBox, pData, 0, __func__);
+}
+
+exception send_wait_timeout( mailbox* mBox, void* pData, uint nTicks){
+	//This call is send_wait with a limit on the blocking
+	//period. If no receiving task has taken the Message
+	//within nTicks ticks it is removed from the mailbox and
+	//the call returns TIMEOUT. The task waits in the
+	//Timerlist until the limit or its deadline, whichever
+	//comes first.
+	//Argument
+	//*mBox a pointer to the specified mailbox.
+	//*Data: a pointer to a memory area where the data of
+	//the communicated Message is residing.
+	//nTicks: the limit in ticks, 0 for none as send_wait.
+	//Return parameter
+	//exception: The exception return parameter can have
+	//four possible values:
+	// OK: Normal behavior, no exception occurred.
+	// TIMEOUT: nTicks passed while the task was
+	//blocked.
+	// DEADLINE_REACHED: the deadline of the task was
+	//reached while it was blocked.
+	// FAIL: the task could not block, the mailbox
+	//is full of blocked tasks or out of memory.
+	
+	//Function
+	return msg_send_wait(mBox, pData, nTicks, __func__);
+}
+
+exception msg_send_wait(mailbox* mBox, void* pData, uint nTicks, const char* pCall){
+	//send_wait_timeout for the public call pCall
+	isr_off_in(pCall); //Disable interrupt
+	TRACE_EVENT(TR_SEND_WAIT, Running, mBox, 1);
+	if(mBox->nBlockedMsg < 0){ //IF receiving task is waiting THEN
+		msg *message;
+		memcpy(mBox->pHead->pNext->pData, pData, mBox->nDataSize); //Copy senders data to the data area of the receivers Message
+		message = msg_extractObj(mBox,NULL); //Remove receiving tasks Message struct from the mailbox
+		unblock(message); //Move receiving task to Readylist
+		deleteMessage(message);
 	}else{ //ELSE
-		if(Running->DeadLine <= tickCounter){ //IF deadline is reached THEN
-			isr_off(); //Disable interrupt
-				
-			msg_extractObj(mBox, List.ready->pHead->pNext->pMessage); //Clean up mailbox entry
-			free(List.ready->pHead->pNext->pMessage->pData);
-			free(List.ready->pHead->pNext->pMessage);
-			
+		msg* message = create_msg(); //Allocate a Message structure
+		if(!message){
+			isr_on(); //Enable interrupt
+			return FAIL;
+		}
+		
+		message->pData = create_data(pData, mBox->nDataSize); //Copy Data to the Message
+		if(!message->pData){										
+			deleteMessage(message);
+			isr_on(); //Enable interrupt
+			return FAIL;
+		}
+		//message->pData = pData; //Set data pointer
+		message->Status = 2;
+		if(msg_insertObj(mBox, message) != OK){ //Add Message to the mailbox
+			deleteData(message->pData); //Full of blocked tasks
+			deleteMessage(message);
 			isr_on(); //Enable interrupt
-			return DEADLINE_REACHED;//Return DEADLINE_REACHED
-		}else{//ELSE
-			return OK; //Return OK
-		}//ENDIF
+			return FAIL;
+		}
+		block_msg(extract(&Running->Node), nTicks); //Move sending task from Readylist to Waitinglist or Timerlist
 	}//ENDIF
-	return OK;
+	SwitchContext(); //Switch task, returns when the sending task runs again
+	return end_msg_wait(mBox, nTicks, pCall);
 }
 
 exception receive_wait( mailbox* mBox, void* pData){
@@ -286,66 +530,86 @@ exception receive_wait( mailbox* mBox, void* pData){
 	//the communicated Message is to be stored.
 	//Return parameter
 	//exception: The exception return parameter can have
-	//two possible values:
+	//three possible values:
 	// OK: Normal function, no exception occurred.
 	// DEADLINE_REACHED: This return parameter
 	//is given if the receiving tasks? deadline is
 	//reached while it is blocked by the receive_wait
 	//call.
+	// FAIL: the task could not block, the mailbox
+	//is full of blocked tasks or out of memory.
 	
 	//Function
-	volatile uint firstExecution = TRUE;
-	isr_off(); //Disable interrupts
-	SaveContext(); //Save context
-	if(firstExecution){ //IF first execution THEN
-		firstExecution = FALSE; //Set: not first execution any more
-		if(mBox->nBlockedMsg >= 0 && mBox->nMessages > 0){ //IF send Message is waiting THEN
-			msg* message;
-			memcpy(pData,mBox->pHead->pNext->pData, mBox->nDataSize); //Copy senders data to receiving tasks data area
-			message = msg_extractObj(mBox, NULL); //Remove sending tasks Message struct from the mailbox
-			if(message->pBlock != NULL){ //IF Message was of wait type THEN
-				insert(List.ready, extract(message->pBlock)); // Move sending task to Ready list
-			}else{ //ELSE
-				deleteData(message->pData); //Free senders data area
-			} //ENDIF
-			//deleteData(message->pData); //F edited
-			deleteMessage(message);
-		}else{ //ELSE
-			msg* message = create_msg(); //Allocate a Message structure
-			if(!message) return FAIL;
-			
-			message->pData = pData;
-			message->Status = 3;
-			msg_insertObj(mBox, message); //Add Message to the mailbox
-			insert(List.waiting, extract(List.ready->pHead->pNext));//Move receiving task from Readylist to Waitinglist
+	return msg_receive_wait(mBox, pData, 0, __func__);
+}
+
+exception receive_wait_timeout( mailbox* mBox, void* pData, uint nTicks){
+	//This call is receive_wait with a limit on the blocking
+	//period. If no Message has arrived within nTicks ticks
+	//the call returns TIMEOUT. The task waits in the
+	//Timerlist until the limit or its deadline, whichever
+	//comes first.
+	//Argument
+	//*mBox: a pointer to the specified mailbox.
+	//*Data: a pointer to a memory area where the data of
+	//the communicated Message is to be stored.
+	//nTicks: the limit in ticks, 0 for none as receive_wait.
+	//Return parameter
+	//exception: The exception return parameter can have
+	//four possible values:
+	// OK: Normal function, no exception occurred.
+	// TIMEOUT: nTicks passed while the task was
+	//blocked.
+	// DEADLINE_REACHED: the deadline of the task was
+	//reached while it was blocked.
+	// FAIL: the task could not block, the mailbox
+	//is full of blocked tasks or out of memory.
+	
+	//Function
+	return msg_receive_wait(mBox, pData, nTicks, __func__);
+}
+
+exception msg_receive_wait(mailbox* mBox, void* pData, uint nTicks, const char* pCall){
+	//receive_wait_timeout for the public call pCall
+	isr_off_in(pCall); //Disable interrupts
+	TRACE_EVENT(TR_RECEIVE_WAIT, Running, mBox, 1);
+	if(mBox->nRingCount > 0){ //IF Message is buffered in the ring THEN
+		ring_get(mBox, pData); //Copy the oldest one to receiving tasks data area
+	}else if(mBox->nBlockedMsg >= 0 && mBox->nMessages > 0){ //IF send Message is waiting THEN
+		msg* message;
+		memcpy(pData,mBox->pHead->pNext->pData, mBox->nDataSize); //Copy senders data to receiving tasks data area
+		message = msg_extractObj(mBox, NULL); //Remove sending tasks Message struct from the mailbox
+		if(message->pBlock != NULL){ //IF Message was of wait type THEN
+			unblock(message); // Move sending task to Ready list
 		} //ENDIF
-		RunningContext(); //Load context
+		deleteData(message->pData); //Free senders data area
+		deleteMessage(message);
 	}else{ //ELSE
-		if(Running->DeadLine <= tickCounter){// IF deadline is reached THEN
-			msg *message;
-			isr_off(); //Disable interrupt
-			
-			//message = msg_extractObj(mBox, List.ready->pHead->pNext->pMessage);
-			//deleteData(message->pData);
-			//deleteMessage(message); //Remove send Message
-			msg_extractObj(mBox, List.ready->pHead->pNext->pMessage); //Clean up mailbox entry
-			free(List.ready->pHead->pNext->pMessage->pData);
-			free(List.ready->pHead->pNext->pMessage);
-			
+		msg* message = create_msg(); //Allocate a Message structure
+		if(!message){
 			isr_on(); //Enable interrupt
-			return DEADLINE_REACHED;//Return DEADLINE_REACHED
-		}else{ //ELSE
-			return OK; //Return OK
-		} //ENDIF
+			return FAIL;
+		}
+		
+		message->pData = pData;
+		message->Status = 3;
+		if(msg_insertObj(mBox, message) != OK){ //Add Message to the mailbox
+			deleteMessage(message); //Full of blocked tasks
+			isr_on(); //Enable interrupt
+			return FAIL;
+		}
+		block_msg(extract(&Running->Node), nTicks); //Move receiving task from Readylist to Waitinglist or Timerlist
 	} //ENDIF
-	return OK;
+	SwitchContext(); //Switch task, returns when the receiving task runs again
+	return end_msg_wait(mBox, nTicks, pCall);
 }
 
 exception send_no_wait( mailbox* mBox, void* pData){
 	//This call will send a Message to the specified mailbox.
 	//The sending task will continue execution after the call.
 	//When the mailbox is full, the oldest Message will be
-	//overwritten. The send_no_wait call will imply a new
+	//overwritten, or FAIL returned if only blocked tasks
+	//hold it. The send_no_wait call will imply a new
 	//scheduling and possibly a context switch. Note:
 	//send_wait and  send_no_wait Messages  shall not be
 	//mixed in the same mailbox.
@@ -357,35 +621,40 @@ exception send_no_wait( mailbox* mBox, void* pData){
 	//Description of the function?s status, i.e. FAIL/OK.
 	
 	//Function
-	volatile uint firstExecution = TRUE;
+	return msg_send_no_wait(mBox, pData, __func__);
+}
+
+exception msg_send_no_wait(mailbox* mBox, void* pData, const char* pCall){
+	//send_no_wait for the public call pCall
+	exception status;
+	isr_off_in(pCall); //Disable interrupts
+	TRACE_EVENT(TR_SEND_NO_WAIT, Running, mBox, 1);
+	status = msg_put(mBox, pData); //Deliver or buffer the Message
+	if(!KeepRunning()) SwitchContext(); //IF receiving task is first THEN switch to it
+	return status; //Return status
+}
+
+int send_no_wait_n( mailbox* mBox, void* pData, uint nItems){
+	//This call will send nItems Messages to the specified
+	//mailbox as nItems send_no_wait calls would, with
+	//interrupts disabled once and at most one new scheduling.
+	//Argument
+	//*mBox: a pointer to the specified mailbox.
+	//*Data: a pointer to nItems Messages of the mailbox size,
+	//one after the other.
+	//nItems: number of Messages to send.
+	//Return parameter
+	//Number of Messages sent. Fewer than nItems only if a
+	//Message could not be allocated.
+	
+	//Function
+	uint nSent = 0;
 	isr_off(); //Disable interrupts
-	SaveContext(); //Save context
-	if(firstExecution){ //IF first execution THEN
-		firstExecution = FALSE; //Set: not first execution anymore
-		if(mBox->nBlockedMsg < 0){//IF receiving task is waiting THEN
-			msg* message;
-			memcpy(mBox->pHead->pNext->pData, pData, mBox->nDataSize); //Copy data to receiving tasks data area.
-			message = msg_extractObj(mBox,NULL); //Remove receiving tasks Message struct from the mailbox
-			insert(List.ready, extract(message->pBlock)); //Move receiving task to Readylist
-			deleteMessage(message);
-			RunningContext(); //Load context
-		}else{ //ELSE
-			msg* message = create_msg();//Allocate a Message structure
-			if(!message) return FAIL;
-			message->pData = create_data(pData, mBox->nDataSize); //Copy Data to the Message
-			if(!message->pData){										//Fun fact, skapar vi data crashar allt fr nTest
-				deleteMessage(message);
-				return FAIL;
-			}
-			//message->pData = pData;
-			message->Status = 4;
-			if(mBox->nMaxMessages == mBox->nMessages){ //IF mailbox is full THEN
-					deleteMessage(msg_extractObj(mBox, NULL)); //Remove the oldest Message struct
-			} //ENDIF
-			msg_insertObj(mBox, message); //Add Message to the mailbox
-		} //ENDIF
-	} //ENDIF
-	return OK; //Return status
+	TRACE_EVENT(TR_SEND_NO_WAIT, Running, mBox, nItems);
+	while(nSent < nItems && msg_put(mBox, (char*)pData + nSent * mBox->nDataSize) == OK)
+		nSent++;
+	if(!KeepRunning()) SwitchContext(); //IF a receiving task is first THEN switch to it
+	return nSent; //Return number sent
 }
 
 exception receive_no_wait( mailbox* mBox, void* pData){
@@ -404,33 +673,669 @@ exception receive_no_wait( mailbox* mBox, void* pData){
 	//received (OK/FAIL).
 	
 	//Function
-	volatile uint firstExecution = TRUE;
-	volatile exception status = FAIL;
+	exception status;
 	isr_off(); //Disable interrupts
-	SaveContext(); //Save context
-	if(firstExecution){ //IF first execution THEN
-		firstExecution = FALSE; //Set: not first execution any more
-		if(mBox->nMessages > 0 && mBox->pHead->pNext->Status != 3){ //IF send Message is waiting THEN //Borde det inte bara kolla om det finns en send  //F ndrat
-			msg* message;
-			memcpy(pData, mBox->pHead->pNext->pData, mBox->nDataSize); //Copy senders data to receiving tasks data area
-			message = msg_extractObj(mBox, NULL); //Remove sending tasks Message struct from the mailbox
-			if(message->pBlock != NULL){ //IF Message was of wait type THEN
-				insert(List.ready, extract(message->pBlock));// Move sending task to Readylist
-			}else{ //ELSE
-				 deleteData(message->pData); //Free senders data area
-			} //ENDIF
-			//deleteData(message->pData); 
-			deleteMessage(message);
-			status = OK;
-		} //ENDIF
-		else{
-			status = FAIL;
+	TRACE_EVENT(TR_RECEIVE_NO_WAIT, Running, mBox, 1);
+	status = msg_get(mBox, pData); //Take a send Message if one is waiting
+	if(!KeepRunning()) SwitchContext(); //IF released sending task is first THEN switch to it
+	
+	return status; //Return status on received Message
+}
+
+int receive_no_wait_n( mailbox* mBox, void* pData, uint nItems){
+	//This call will receive up to nItems Messages from the
+	//specified mailbox as receive_no_wait calls would, with
+	//interrupts disabled once and one new scheduling.
+	//Argument
+	//*mBox: a pointer to the specified mailbox.
+	//*Data: a pointer to room for nItems Messages of the
+	//mailbox size, one after the other.
+	//nItems: most Messages to receive.
+	//Return parameter
+	//Number of Messages received, 0 if the mailbox had none.
+	
+	//Function
+	uint nReceived = 0;
+	isr_off(); //Disable interrupts
+	TRACE_EVENT(TR_RECEIVE_NO_WAIT, Running, mBox, nItems);
+	while(nReceived < nItems && msg_get(mBox, (char*)pData + nReceived * mBox->nDataSize) == OK)
+		nReceived++;
+	if(!KeepRunning()) SwitchContext(); //IF a released sending task is first THEN switch to it
+	return nReceived; //Return number received
+}
+
+//Zero-copy buffers
+mailbox* create_buffer_mailbox(uint nMessages){
+	//This call will create a mailbox that passes buffers from
+	//create_buffer by pointer. Only the pointer is copied, so
+	//the cost of a Message does not depend on the size of the
+	//buffer. The mailbox is a ring mailbox of pointers, see
+	//create_ring_mailbox. Use send_buffer and receive_buffer,
+	//or receive_no_wait(mBox, &pBuffer) to poll it.
+	//Argument
+	//nof_msg: Maximum number of buffers the mailbox can hold.
+	//When it is full the oldest buffer is released.
+	//Return parameter
+	//mailbox*: a pointer to the created mailbox or NULL.
+	
+	//Function
+	mailbox* mBox = make_ring_mailbox(nMessages, sizeof(void*), __func__);
+	if(!mBox) return NULL;
+	mBox->bBuffers = TRUE;
+	return mBox; //Return mailbox*
+}
+
+void* create_buffer(uint nSize){
+	//This call will allocate a buffer of nSize bytes from the
+	//Message data heap, to be filled in place and sent with
+	//send_buffer.
+	//Return parameter
+	//void*: a pointer to the buffer or NULL.
+	
+	//Function
+	void* pBuffer;
+	isr_off(); //Heap is shared with the mailbox calls
+	pBuffer = tlsf_alloc(&Heap, nSize); //Not cleared, the sender fills it
+	isr_on();
+	return pBuffer;
+}
+
+void release_buffer(void* pBuffer){
+	//This call will give a buffer back to the heap. The task
+	//that owns the buffer, the one that got it from
+	//create_buffer or receive_buffer, must release it.
+	
+	//Function
+	isr_off();
+	deleteData((char*)pBuffer);
+	isr_on();
+}
+
+exception send_buffer(mailbox* mBox, void* pBuffer){
+	//This call will send a buffer to the specified buffer
+	//mailbox as send_no_wait does. The buffer is owned by the
+	//mailbox and then by the receiving task, the sending task
+	//must not use it after the call.
+	//Argument
+	//*mBox: a pointer to a mailbox from create_buffer_mailbox.
+	//*pBuffer: a buffer from create_buffer.
+	//Return parameter
+	//Description of the function?s status, i.e. FAIL/OK.
+	
+	//Function
+	if(!mBox->bBuffers) return FAIL;
+	return msg_send_no_wait(mBox, &pBuffer, __func__);
+}
+
+exception receive_buffer(mailbox* mBox, void** ppBuffer){
+	//This call will receive a buffer from the specified buffer
+	//mailbox as receive_wait does. The receiving task owns the
+	//buffer and releases it with release_buffer.
+	//Argument
+	//*mBox: a pointer to a mailbox from create_buffer_mailbox.
+	//**ppBuffer: where the pointer to the buffer is stored,
+	//NULL if no buffer was received.
+	//Return parameter
+	//OK or DEADLINE_REACHED, see receive_wait. FAIL if mBox
+	//is not a buffer mailbox.
+	
+	//Function
+	*ppBuffer = NULL;
+	if(!mBox->bBuffers) return FAIL;
+	return msg_receive_wait(mBox, ppBuffer, 0, __func__);
+}
+
+//Mutexes
+mutex* create_mutex(uint nCeiling){
+	//This call will create a mutex for the Stack Resource
+	//Policy. A task locks it without ever blocking: a task that
+	//could find it locked is not started while it is locked.
+	//Each task is blocked by at most one critical section, at
+	//its start. The preemption level of a task is its relative
+	//deadline when it was created, see create_periodic_task.
+	//Mutexes must be unlocked in the reverse order of locking
+	//and a task must not block while it holds one.
+	//Argument
+	//nCeiling: the shortest relative deadline of the tasks
+	//that lock the mutex, in ticks.
+	//Return parameter
+	//mutex*: a pointer to the created mutex or NULL.
+	
+	//Function
+	mutex* pMutex;
+	isr_off(); //Pool shared with running tasks
+	pMutex = (mutex*)pool_alloc(&Pools[POOL_MUTEX]);
+	isr_on();
+	if(!pMutex) return NULL;
+	pMutex->nCeiling = nCeiling;
+	return pMutex; //Return mutex*
+}
+
+exception remove_mutex(mutex* pMutex){
+	//This call will remove a mutex that is not locked.
+	//Argument
+	//*pMutex: a pointer to the mutex.
+	//Return parameter
+	//FAIL if the mutex is locked, OK otherwise.
+	
+	//Function
+	if(pMutex->pOwner) return FAIL;
+	isr_off();
+	pool_free(&Pools[POOL_MUTEX], pMutex);
+	isr_on();
+	return OK;
+}
+
+exception lock_mutex(mutex* pMutex){
+	//This call will lock a mutex and raise the system ceiling
+	//to its ceiling. It does not block or switch task.
+	//Argument
+	//*pMutex: a pointer to the mutex.
+	//Return parameter
+	//FAIL if the mutex is locked, only when the ceiling is
+	//longer than the relative deadline of a task that locks
+	//it. OK otherwise.
+	
+	//Function
+	isr_off(); //Disable interrupts
+	if(pMutex->pOwner){ //IF locked THEN the ceiling is wrong
+		isr_on();
+		return FAIL;
+	} //ENDIF
+	pMutex->pOwner = Running;
+	pMutex->pBelow = pLocked; //Push on the locked mutexes
+	pMutex->nPrevCeiling = nSystemCeiling;
+	pLocked = pMutex;
+	if(pMutex->nCeiling < nSystemCeiling) nSystemCeiling = pMutex->nCeiling;
+	isr_on(); //Enable interrupts
+	return OK;
+}
+
+exception unlock_mutex(mutex* pMutex){
+	//This call will unlock the mutex the calling task locked
+	//last and lower the system ceiling again. A task kept from
+	//starting by the ceiling may then preempt the calling task.
+	//Argument
+	//*pMutex: a pointer to the mutex.
+	//Return parameter
+	//FAIL if the mutex is not the last one the calling task
+	//locked, OK otherwise.
+	
+	//Function
+	isr_off(); //Disable interrupts
+	if(pLocked != pMutex || pMutex->pOwner != Running){
+		isr_on();
+		return FAIL;
+	}
+	pLocked = pMutex->pBelow; //Pop the locked mutexes
+	nSystemCeiling = pMutex->nPrevCeiling;
+	pMutex->pOwner = NULL;
+	if(!KeepRunning()) SwitchContext(); //IF a waiting task may start THEN switch to it
+	return OK;
+}
+
+//Semaphores and event flags
+semaphore* create_semaphore(uint nCount){
+	//This call will create a counting semaphore. Tasks that
+	//wait for it are queued in the semaphore itself, waiting
+	//and signalling never allocate.
+	//Argument
+	//nCount: the initial count.
+	//Return parameter
+	//semaphore*: a pointer to the created semaphore or NULL.
+	
+	//Function
+	semaphore* pSem;
+	isr_off(); //Pool shared with running tasks
+	pSem = (semaphore*)pool_alloc(&Pools[POOL_SEMAPHORE]);
+	isr_on();
+	if(!pSem) return NULL;
+	pSem->nCount = nCount;
+	return pSem; //Return semaphore*
+}
+
+exception remove_semaphore(semaphore* pSem){
+	//This call will remove a semaphore no task waits for.
+	//Return parameter
+	//FAIL if a task waits for it, OK otherwise.
+	
+	//Function
+	if(pSem->Waiters.pFirst) return FAIL;
+	isr_off();
+	pool_free(&Pools[POOL_SEMAPHORE], pSem);
+	isr_on();
+	return OK;
+}
+
+exception wait_semaphore(semaphore* pSem){
+	//This call will take one from the count of the semaphore.
+	//If the count is 0 the calling task is blocked until a
+	//signal_semaphore gives it one or its deadline is
+	//reached.
+	//Argument
+	//*pSem: a pointer to the semaphore.
+	//Return parameter
+	//exception: The exception return parameter can have
+	//two possible values:
+	// OK: Normal function, no exception occurred.
+	// DEADLINE_REACHED: The deadline of the task was
+	//reached while it was blocked.
+	
+	//Function
+	isr_off(); //Disable interrupts
+	if(pSem->nCount){ //IF count left THEN take one
+		pSem->nCount--;
+		isr_on(); //Enable interrupts
+		return OK;
+	} //ENDIF
+	return block_on(&pSem->Waiters, __func__); //Wait for a signal
+}
+
+void signal_semaphore(semaphore* pSem){
+	//This call will add one to the count of the semaphore, or
+	//give it to the task that has waited the longest. That
+	//task is moved to the Readylist and may preempt the
+	//calling task.
+	//Argument
+	//*pSem: a pointer to the semaphore.
+	
+	//Function
+	isr_off(); //Disable interrupts
+	if(pSem->Waiters.pFirst) //IF a task waits THEN release it
+		release(pSem->Waiters.pFirst);
+	else
+		pSem->nCount++;
+	if(!KeepRunning()) SwitchContext(); //IF released task is first THEN switch to it
+}
+
+eventgroup* create_event(void){
+	//This call will create a group of 32 event flags, all
+	//clear. As for semaphores the waiting tasks are queued in
+	//the group itself.
+	//Return parameter
+	//eventgroup*: a pointer to the created group or NULL.
+	
+	//Function
+	eventgroup* pEvent;
+	isr_off(); //Pool shared with running tasks
+	pEvent = (eventgroup*)pool_alloc(&Pools[POOL_EVENT]);
+	isr_on();
+	return pEvent; //Return eventgroup*
+}
+
+exception remove_event(eventgroup* pEvent){
+	//This call will remove an event group no task waits for.
+	//Return parameter
+	//FAIL if a task waits for it, OK otherwise.
+	
+	//Function
+	if(pEvent->Waiters.pFirst) return FAIL;
+	isr_off();
+	pool_free(&Pools[POOL_EVENT], pEvent);
+	isr_on();
+	return OK;
+}
+
+exception wait_event(eventgroup* pEvent, uint nMask, uint nMode, uint* pFlags){
+	//This call will wait until any (EVENT_ANY) or all
+	//(EVENT_ALL) of the flags in nMask are set. With
+	//EVENT_CLEAR or-ed into nMode the flags of the mask are
+	//cleared when the wait ends. The calling task is blocked
+	//until set_event sets the flags or its deadline is
+	//reached.
+	//Argument
+	//*pEvent: a pointer to the event group.
+	//nMask: the flags to wait for.
+	//nMode: EVENT_ANY or EVENT_ALL, and EVENT_CLEAR.
+	//*pFlags: where the flags of nMask that were set are
+	//stored, may be NULL.
+	//Return parameter
+	//exception: The exception return parameter can have
+	//two possible values:
+	// OK: Normal function, no exception occurred.
+	// DEADLINE_REACHED: The deadline of the task was
+	//reached while it was blocked, *pFlags is 0.
+	
+	//Function
+	uint nSet;
+	exception status;
+	isr_off(); //Disable interrupts
+	nSet = pEvent->nFlags & nMask;
+	if(nMode & EVENT_ALL ? nSet == nMask : nSet != 0){ //IF already set THEN
+		if(nMode & EVENT_CLEAR) pEvent->nFlags &= ~nMask;
+		isr_on(); //Enable interrupts
+	}else{ //ELSE wait for set_event
+		Running->nWaitMask = nMask;
+		Running->nWaitMode = nMode;
+		status = block_on(&pEvent->Waiters, __func__);
+		nSet = status == OK ? Running->nWaitMask : 0; //Released by these flags
+		if(pFlags) *pFlags = nSet;
+		return status;
+	} //ENDIF
+	if(pFlags) *pFlags = nSet;
+	return OK;
+}
+
+void set_event(eventgroup* pEvent, uint nFlags){
+	//This call will set flags of an event group and release
+	//every waiting task whose wait they end, in the order they
+	//started waiting. All waiters see the same flags, those
+	//of EVENT_CLEAR waits are cleared afterwards. A released
+	//task may preempt the calling task.
+	//Argument
+	//*pEvent: a pointer to the event group.
+	//nFlags: the flags to set.
+	
+	//Function
+	TCB* pTask;
+	TCB* pNext;
+	uint nClear = 0;
+	isr_off(); //Disable interrupts
+	pEvent->nFlags |= nFlags;
+	for(pTask = pEvent->Waiters.pFirst; pTask; pTask = pNext){
+		uint nSet = pEvent->nFlags & pTask->nWaitMask;
+		pNext = pTask->pWaitNext;
+		if(pTask->nWaitMode & EVENT_ALL ? nSet == pTask->nWaitMask : nSet != 0){
+			if(pTask->nWaitMode & EVENT_CLEAR) nClear |= pTask->nWaitMask;
+			pTask->nWaitMask = nSet;
+			release(pTask);
+		}
+	}
+	pEvent->nFlags &= ~nClear;
+	if(!KeepRunning()) SwitchContext(); //IF a released task is first THEN switch to it
+}
+
+void clear_event(eventgroup* pEvent, uint nFlags){
+	//This call will clear flags of an event group.
+	//Argument
+	//*pEvent: a pointer to the event group.
+	//nFlags: the flags to clear.
+	
+	//Function
+	isr_off(); //Disable interrupts
+	pEvent->nFlags &= ~nFlags;
+	isr_on(); //Enable interrupts
+}
+
+//Interrupt to task channels
+channel* create_channel(uint nSlots, uint nDataSize){
+	//This call will create a channel from one interrupt
+	//handler to one task, a ring of nSlots items of nDataSize
+	//bytes. The handler puts items with channel_send_isr
+	//without disabling interrupts or allocating, the task
+	//takes them with channel_receive_wait or
+	//channel_receive_no_wait.
+	//Argument
+	//nSlots: number of items, rounded up to a power of two.
+	//nDataSize: the size of one item in bytes.
+	//Return parameter
+	//channel*: a pointer to the created channel or NULL.
+	
+	//Function
+	channel* pChan;
+	uint nSize = 1;
+	if(!nSlots || !nDataSize) return NULL;
+	while(nSize < nSlots) nSize <<= 1;
+	isr_off(); //Pool and heap shared with running tasks
+	pChan = (channel*)pool_alloc(&Pools[POOL_CHANNEL]);
+	if(pChan){
+		pChan->pRing = create_data(NULL, nSize * nDataSize);
+		if(!pChan->pRing){
+			pool_free(&Pools[POOL_CHANNEL], pChan);
+			pChan = NULL;
 		}
-		RunningContext(); //Load context
+	}
+	isr_on();
+	if(!pChan) return NULL;
+	pChan->nMask = nSize - 1;
+	pChan->nDataSize = nDataSize;
+	return pChan; //Return channel*
+}
+
+exception remove_channel(channel* pChan){
+	//This call will remove a channel no task waits for. The
+	//interrupt handler must no longer use it.
+	//Return parameter
+	//FAIL if a task waits for it, OK otherwise.
+	
+	//Function
+	if(pChan->pWaiter || pChan->bWake) return FAIL;
+	isr_off();
+	deleteData(pChan->pRing);
+	pool_free(&Pools[POOL_CHANNEL], pChan);
+	isr_on();
+	return OK;
+}
+
+exception channel_send_isr(channel* pChan, void* pData){
+	//This call puts one item in a channel, from the interrupt
+	//handler that owns it. It does not disable interrupts,
+	//allocate or switch task. A consumer blocked on the
+	//channel is woken when the handler calls isr_exit, or at
+	//the next tick. Handlers that send must not nest: the
+	//wakeup is pushed on a list shared by all channels with
+	//plain stores, and a nested send could lose one. On the
+	//ARM7 IRQs stay masked in the handler unless it enables
+	//them.
+	//Argument
+	//*pChan: a pointer to the channel.
+	//*pData: the item.
+	//Return parameter
+	//FAIL if the ring is full, the item is dropped and
+	//counted in nLost, OK otherwise.
+	
+	//Function
+	uint nHead = pChan->nHead;
+	if(nHead - pChan->nTail > pChan->nMask){ //IF full THEN drop
+		pChan->nLost++;
+		return FAIL;
 	} //ENDIF
+	memcpy(pChan->pRing + (nHead & pChan->nMask) * pChan->nDataSize, pData, pChan->nDataSize);
+	BARRIER(); //Item written before it is published
+	pChan->nHead = nHead + 1;
+	if(pChan->pWaiter && !pChan->bWake){ //IF consumer is blocked THEN wake it on exit
+		pChan->bWake = TRUE;
+		pChan->pNextWake = pWakeList; //Tasks only touch the list with interrupts off
+		pWakeList = pChan;
+	} //ENDIF
+	return OK;
+}
+
+exception channel_receive_no_wait(channel* pChan, void* pData){
+	//This call takes the oldest item from a channel, if there
+	//is one. The calling task must be the only consumer.
+	//Argument
+	//*pChan: a pointer to the channel.
+	//*pData: where the item is stored.
+	//Return parameter
+	//FAIL if the channel is empty, OK otherwise.
 	
-	return status; //Return status on received Message
+	//Function
+	uint nTail = pChan->nTail;
+	if(pChan->nHead == nTail) return FAIL; //Empty
+	BARRIER(); //Item read after nHead
+	memcpy(pData, pChan->pRing + (nTail & pChan->nMask) * pChan->nDataSize, pChan->nDataSize);
+	BARRIER(); //Slot free once read
+	pChan->nTail = nTail + 1;
+	return OK;
 }
+
+exception channel_receive_wait(channel* pChan, void* pData){
+	//This call takes the oldest item from a channel. If the
+	//channel is empty the calling task is blocked until the
+	//interrupt handler puts one or its deadline is reached.
+	//Argument
+	//*pChan: a pointer to the channel.
+	//*pData: where the item is stored.
+	//Return parameter
+	//exception: The exception return parameter can have
+	//two possible values:
+	// OK: Normal function, no exception occurred.
+	// DEADLINE_REACHED: The deadline of the task was
+	//reached while it was blocked.
+	
+	//Function
+	isr_off(); //Disable interrupts, the handler cannot put meanwhile
+	if(pChan->nHead == pChan->nTail){ //IF empty THEN wait for the handler
+		pChan->pWaiter = Running;
+		insert(List.waiting, extract(&Running->Node)); //Move calling task from Readylist to Waitinglist
+		SwitchContext(); //Switch task, returns when the calling task runs again
+		isr_off();
+		if(pChan->pWaiter == Running){ //IF not woken by the handler THEN deadline is reached
+			pChan->pWaiter = NULL;
+			Running->Stat.nMisses++;
+			isr_on();
+			return DEADLINE_REACHED;
+		} //ENDIF
+	} //ENDIF
+	isr_on(); //Enable interrupts
+	return channel_receive_no_wait(pChan, pData);
+}
+
+void isr_exit(void){
+	//This call is made last by an interrupt handler that puts
+	//items with channel_send_isr, with the context of the
+	//interrupted task saved as for TimerInt. It moves the woken
+	//consumers to the Readylist and makes the first task
+	//Running, the handler then loads its context. A handler
+	//that comes while the tick walks the lists, see
+	//isr_nested, saves and loads nothing: the walk goes on
+	//when it returns and the tick wakes the consumers last.
+	
+	//Function
+	ISR_STAT_BEGIN(__func__);
+#ifdef SOFTIRQ
+	if(bSoftIrq){ //Nested in TimerInt(), the lists and Running are the tick's
+		ISR_STAT_END();
+		return;
+	}
+#endif
+	wake_deferred();
+	dispatch(next_task());
+	TRACE_EVENT(TR_RUN, Running, NULL, 0);
+	ISR_STAT_END();
+}
+
+bool isr_nested(void){
+	//TRUE while TimerInt() walks the lists with interrupts on,
+	//SOFTIRQ. An interrupt handler taken then runs inside the
+	//tick and must not save or load a context.
+	
+	//Function
+#ifdef SOFTIRQ
+	return bSoftIrq;
+#else
+	return FALSE;
+#endif
+}
+
+//Kernel objects
+exception pool_stats(uint nPool, poolstat* pStat){
+	//This call copies the usage counters of one kernel object
+	//pool. TCBs are bounded by MAX_TASKS,
+	//Message structs by MAX_MESSAGES, mailboxes by
+	//MAX_MAILBOXES, mutexes by MAX_MUTEXES, semaphores by
+	//MAX_SEMAPHORES, event groups by MAX_EVENTS and channels
+	//by MAX_CHANNELS.
+	//Argument
+	//nPool: POOL_TCB, POOL_MSG, POOL_MAILBOX, POOL_MUTEX,
+	//POOL_SEMAPHORE, POOL_EVENT or POOL_CHANNEL.
+	//*pStat: a pointer to where the counters are stored.
+	//Return parameter
+	//FAIL if nPool is not a pool, OK otherwise.
+
+	//Function
+	if(nPool >= NOF_POOLS || !pStat) return FAIL;
+	isr_off(); //Counters read together
+	*pStat = Pools[nPool].Stat;
+	isr_on();
+	return OK;
+}
+
+void heap_stats(heapstat* pStat){
+	//This call copies the usage counters of the heap holding
+	//the data of buffered Messages, HEAP_SIZE bytes.
+	//Argument
+	//*pStat: a pointer to where the counters are stored.
+
+	//Function
+	isr_off(); //Counters read together
+	tlsf_stats(&Heap, pStat);
+	isr_on();
+}
+
+uint task_id(void){
+	//This call returns the id of the running task, 0 to
+	//MAX_TASKS-1. The id is fixed for the life of the task and
+	//is given to a new task after it has terminated.
+	
+	//Function
+	return Running->nId;
+}
+
+exception task_stack_usage(uint nTask, stackstat* pStat){
+	//This call reports the stack size of a task and the most
+	//of it that has been used, found as the words below the
+	//lowest one that no longer holds STACK_FILL.
+	//Argument
+	//nTask: id of the task, see task_id.
+	//*pStat: a pointer to where the sizes are stored.
+	//Return parameter
+	//FAIL if there is no task with that id, OK otherwise.
+	
+	//Function
+	uint* pStack;
+	uint nSize, nFree = 0;
+	if(nTask >= MAX_TASKS || !pStat) return FAIL;
+	isr_off(); //Task can not go away while it is looked up
+	if(!Tasks[nTask]){
+		isr_on();
+		return FAIL;
+	}
+	pStack = Tasks[nTask]->pStack;
+	nSize = Tasks[nTask]->nStackSize;
+	isr_on();
+	while(nFree < nSize && pStack[nFree] == STACK_FILL) //Stacks grow down
+		nFree++;
+	pStat->nSize = nSize;
+	pStat->nPeak = nSize - nFree;
+	return OK;
+}
+
+exception task_stats(uint nTask, taskstat* pStat){
+	//This call copies the run time and scheduling counters of
+	//a task, counted since it was created. The time it has run
+	//is in timer0_stamp() counts, the time it has spent in each
+	//list in ticks. For the calling task the current run and
+	//list stay are included.
+	//Argument
+	//nTask: id of the task, see task_id.
+	//*pStat: a pointer to where the counters are stored.
+	//Return parameter
+	//FAIL if there is no task with that id, OK otherwise.
+	
+	//Function
+	TCB* pTask;
+	if(nTask >= MAX_TASKS || !pStat) return FAIL;
+	isr_off(); //Counters read together
+	pTask = Tasks[nTask];
+	if(!pTask){
+		isr_on();
+		return FAIL;
+	}
+	*pStat = pTask->Stat;
+	if(pTask == Running) //Up to now
+		pStat->nRun += timer0_stamp(tickCounter) - pTask->nStamp;
+	if(pTask->Node.pList == List.ready)
+		pStat->nReady += NOW() - pTask->nSince;
+	else if(pTask->Node.pList == List.waiting)
+		pStat->nWaiting += NOW() - pTask->nSince;
+	else if(pTask->Node.pList)
+		pStat->nTimer += NOW() - pTask->nSince;
+	isr_on();
+	return OK;
+}
+
 //Timing functions
 exception wait(uint nTicks){
 	//This call will block the calling task until the given
@@ -448,32 +1353,97 @@ exception wait(uint nTicks){
 	
 	//Function
 	exception status;
-	volatile uint firstExecution = TRUE;
 	isr_off(); //Disable interrupt
-	
-	SaveContext(); //Save context
-	if(firstExecution){ //IF first execution THEN
-		firstExecution = FALSE; //Set: not first execution any more
-		List.ready->pHead->pNext->nTCnt = nTicks + tickCounter;
-		insert(List.timer, extract(List.ready->pHead->pNext)); //Place running task in the Timerlist
-		RunningContext(); //Load context
+	Running->Node.nTCnt = nTicks + NOW();
+	insert(List.timer, extract(&Running->Node)); //Place running task in the Timerlist
+	SwitchContext(); //Switch task, returns when the calling task runs again
+	if(NOW() >= Running->DeadLine){//IF deadline is reached THEN
+		Running->Stat.nMisses++;
+		status = DEADLINE_REACHED; //Status is DEADLINE_REACHED
 	}else{ //ELSE
-		if(tickCounter >= Running->DeadLine){//IF deadline is reached THEN
-			status = DEADLINE_REACHED; //Status is DEADLINE_REACHED
-		}else{ //ELSE
-			status = OK;//Status is OK
-		} //ENDIF
+		status = OK;//Status is OK
 	} //ENDIF
 	return status; //Return status
 }
 
+exception wait_until(uint nTick){
+	//This call will block the calling task until the tick
+	//counter reaches nTick. For a periodic task, see
+	//create_periodic_task, a new period starts at nTick: its
+	//deadline becomes nTick plus its relative deadline in the
+	//same call. If nTick has passed the task is not blocked,
+	//the new period starts late. The delay from nTick to the
+	//task running again is its release jitter, see task_stats.
+	//Argument
+	//nTick: the tick to wait for
+	//Return parameter
+	//exception: The exception return parameter can have
+	//two possible values:
+	// OK: Normal function, no exception occurred.
+	// DEADLINE_REACHED: The deadline of a task that is
+	//not periodic was reached while it was blocked.
+	
+	//Function
+	listobj* pObj;
+	TCB* pTask;
+	uint nJitter;
+	isr_off(); //Disable interrupt
+	pObj = extract(&Running->Node); //Calling task out of the Readylist
+	if(Running->nPeriod){ //IF periodic THEN start the next period
+		Running->nRelease = nTick;
+		Running->DeadLine = nTick + Running->nRelDeadline;
+	} //ENDIF
+	if(nTick > NOW()){ //IF nTick is ahead THEN
+		pObj->nTCnt = nTick;
+		insert(List.timer, pObj); //Place calling task in the Timerlist
+		SwitchContext(); //Switch task, returns when the calling task runs again
+	}else{ //ELSE
+		insert(List.ready, pObj); //Released at once
+		if(!KeepRunning()) SwitchContext(); //IF another task is first THEN switch to it
+	} //ENDIF
+	if(!Running->nPeriod){ //IF not periodic THEN as wait()
+		if(NOW() >= Running->DeadLine){
+			Running->Stat.nMisses++;
+			return DEADLINE_REACHED;
+		}
+		return OK;
+	} //ENDIF
+	isr_off(); //Tick and count read together
+	pTask = Running;
+	nJitter = (tickCounter - pTask->nRelease) * timer0_tick_counts() + timer0_count();
+	pTask->Stat.nReleases++;
+	pTask->Stat.nJitter = nJitter;
+	if(nJitter > pTask->Stat.nJitterMax) pTask->Stat.nJitterMax = nJitter;
+	isr_on(); //Enable interrupt
+	return OK;
+}
+
+exception wait_next_period(void){
+	//This call ends the current period of a periodic task, see
+	//create_periodic_task. The task is blocked until its next
+	//period starts, one period after the last one started, and
+	//gets the deadline of that period. Release times do not
+	//drift with the time the task runs.
+	//Return parameter
+	//FAIL if the calling task is not periodic, OK otherwise.
+	
+	//Function
+	if(!Running->nPeriod) return FAIL;
+	return wait_until(Running->nRelease + Running->nPeriod);
+}
+
 void set_ticks( uint nTicks){
 	//This call will set the tick counter to the given value.
 	//Argument
 	//nTicks: the new value of the tick counter
 	
 	//Function
+#ifdef TICKLESS
+	tickCounter = nTicks - (NOW() - tickCounter); //Set the tick counter.
+#else
 	tickCounter = nTicks; //Set the tick counter.
+#endif
+	if(List.timer) tw_setTime(List.timer->pWheel, nTicks); //Keep the Timerlist on the same time base
 }
 
 uint ticks(void){
@@ -482,7 +1452,15 @@ uint ticks(void){
 	//A 32 bit value of the tick counter
 	
 	//Function
+#ifdef TICKLESS
+	uint nTicks;
+	isr_off(); //Counter and timer read together
+	nTicks = NOW();
+	isr_on();
+	return nTicks; //Return the tick counter
+#else
 	return tickCounter; //Return the tick counter
+#endif
 }
 
 uint deadline(void){
@@ -502,15 +1480,14 @@ void set_deadline(uint deadline){
 	//deadline: the new deadline given in number of ticks.
 	
 	//Function
-	volatile uint firstExecution = TRUE;
+	listobj* pObj;
 	isr_off(); //Disable interrupt
-	SaveContext(); //Save context
-	if(firstExecution){ //IF first execution THEN
-		firstExecution = FALSE; //Set: not first execution any more
+	if(deadline != Running->DeadLine){ //IF deadline changes THEN
+		pObj = extract(&Running->Node); //Take the calling task out before its key changes
 		Running->DeadLine = deadline; //Set the deadline field in the calling TCB.
-		insert(List.ready,extract(List.ready->pHead->pNext)); //Reschedule Readylist (Lazy way)
-		RunningContext(); //Load context
+		insert(List.ready, pObj); //Reschedule Readylist
 	} //ENDIF
+	if(!KeepRunning()) SwitchContext(); //IF another task is first THEN switch to it
 }
 
 void TimerInt(void){
@@ -518,29 +1495,291 @@ void TimerInt(void){
 	//It is called by an ISR (Interrupt Service Routine)
 	//invoked every tick. Note, context is automatically saved
 	//prior to call and automatically loaded on function exit.
+	//With SOFTIRQ only the tick count is updated with
+	//interrupts off, the lists are walked by tick_work() with
+	//them on. A tick that comes meanwhile nests, is counted
+	//and returns at once, and the walk is repeated for it.
 	
 	//Function
-	tickCounter++; //Increment tick counter
-	//Check the Timerlist for tasks that are ready for
-	//execution, move these to Readylist
-	while(List.timer->pHead->pNext != List.timer->pTail && List.timer->pHead->pNext->nTCnt <= tickCounter){
-			insert(List.ready, extract(List.timer->pHead->pNext));
+#ifdef SOFTIRQ
+	uint nNow;
+	ISR_STAT_BEGIN(__func__);
+	tickCounter += nShotTicks; //Increment tick counter, several ticks when tickless
+	if(bSoftIrq){ //Nested, the walk below sees the new count
+		ISR_STAT_END();
+		return;
+	}
+	TRACE_EVENT(TR_TICK, Running, NULL, nShotTicks);
+	bSoftIrq = TRUE;
+	do{
+		nNow = tickCounter;
+		isr_on(); //No task runs, the kernel lists are ours
+		tick_work(nNow);
+		isr_off();
+	}while(nNow != tickCounter);
+	bSoftIrq = FALSE;
+#else
+	ISR_STAT_BEGIN(__func__);
+	tickCounter += nShotTicks; //Increment tick counter, several ticks when tickless
+	TRACE_EVENT(TR_TICK, Running, NULL, nShotTicks);
+	tick_work(tickCounter);
+#endif
+	wake_deferred(); //Consumers of channels, if no handler called isr_exit()
+	dispatch(next_task());
+	TRACE_EVENT(TR_RUN, Running, NULL, 0);
+	program_shot();
+	ISR_STAT_END();
 	}
+
+void tick_work(uint nNow){
+	//Release the tasks of the ticks up to nNow: the Timerlist
+	//entries that expire and the Waitinglist tasks whose
+	//deadline is reached, to the Readylist in one batch each.
+	listobj* pExpired = NULL;
+	//Check the Timerlist for tasks that are ready for
+	//execution, move these to Readylist in one batch
+	insertChain(List.ready, tw_advance(List.timer->pWheel, nNow));
 	
 	//Check the Waitinglist for tasks that have expired
 	//deadlines, move these to Readylist and clean up
 	//their mailbox entry.
-	while(List.waiting->pHead->pNext != List.waiting->pTail && List.waiting->pHead->pNext->pTask->DeadLine <= tickCounter){
-		insert(List.ready, extract(List.waiting->pHead->pNext)); //List.waiting->pHead->pNext->pMessage->pData	
-	}
-	Running = List.ready->pHead->pNext->pTask;
+	while(first(List.waiting) && first(List.waiting)->pTask->DeadLine <= nNow){
+		listobj* pObj = extract(first(List.waiting)); //List.waiting->pHead->pNext->pMessage->pData	
+		pObj->pNext = pExpired;
+		pExpired = pObj;
 	}
+	insertChain(List.ready, pExpired);
+}
 
 void RunningContext(){
-	Running = List.ready->pHead->pNext->pTask;
+	dispatch(next_task());
+	TRACE_EVENT(TR_RUN, Running, NULL, 0);
+	program_shot();
+	ISR_STAT_END(); //The task's own interrupt state is loaded
 	LoadContext(); //Load context
 }
 
+unsigned long long utilisation(TCB* pTask){
+	//nWcet / nPeriod rounded up, 1 << 32 is the whole CPU. The sum
+	//is never below the real utilisation.
+	return (((unsigned long long)pTask->nWcet << 32) + pTask->nPeriod - 1) / pTask->nPeriod;
+}
+
+uint overloaded(void){
+	//The utilisation of the periodic tasks exceeds 1, exactly: the
+	//sum of nWcet / nPeriod over a common period D. Also TRUE if D
+	//would exceed ADMIT_PERIOD, it cannot be told then.
+	unsigned long long d = 1, n = 0, a, b, r;
+	uint i;
+	for(i = 0; i < MAX_TASKS; i++){
+		TCB* pTask = Tasks[i];
+		if(!pTask || !pTask->nPeriod) continue;
+		for(a = d, b = pTask->nPeriod; b; a = b, b = r) //gcd(d, nPeriod)
+			r = a % b;
+		if(pTask->nPeriod / a > ADMIT_PERIOD / d) return TRUE;
+		a = pTask->nPeriod / a; //d grows by this factor
+		d *= a;
+		n = n * a + (unsigned long long)pTask->nWcet * (d / pTask->nPeriod);
+	}
+	return n > d;
+}
+
+uint demand(uint t){
+	//Processor demand of the periodic tasks up to time t, the
+	//execution of all their jobs with a deadline at or before t
+	//when they all start at time 0
+	uint i, h = 0;
+	for(i = 0; i < MAX_TASKS; i++){
+		TCB* pTask = Tasks[i];
+		if(pTask && pTask->nPeriod && pTask->nRelDeadline <= t)
+			h += ((t - pTask->nRelDeadline) / pTask->nPeriod + 1) * pTask->nWcet;
+	}
+	return h;
+}
+
+exception admit(void){
+	//EDF test of the periodic tasks, Tasks[] and the sums hold the
+	//new task. With all deadlines at the end of the period the
+	//utilisation is the test. Otherwise QPA (Zhang and Burns):
+	//from the last deadline in the busy period go down the
+	//deadlines, skipping to the demand when it is lower, until
+	//the demand exceeds the time or is within the first deadline.
+	//Interrupts are off, so a set that takes more than ADMIT_STEPS
+	//passes over Tasks[] to check is rejected.
+	uint i, t, h, w, nNext, nMin = UINT_MAX, nSteps = 0;
+	if(nUtilisation > ((unsigned long long)1 << 32) && overloaded()) return NOT_SCHEDULABLE; //Rounded up, check exactly
+	if(!nConstrained) return OK;
+	
+	for(w = 0, i = 0; i < MAX_TASKS; i++){ //Synchronous busy period
+		if(Tasks[i] && Tasks[i]->nPeriod){
+			w += Tasks[i]->nWcet;
+			if(Tasks[i]->nRelDeadline < nMin) nMin = Tasks[i]->nRelDeadline;
+		}
+	}
+	do{
+		for(nNext = 0, i = 0; i < MAX_TASKS; i++)
+			if(Tasks[i] && Tasks[i]->nPeriod)
+				nNext += (w + Tasks[i]->nPeriod - 1) / Tasks[i]->nPeriod * Tasks[i]->nWcet;
+		if(nNext > ADMIT_LIMIT || ++nSteps > ADMIT_STEPS) return NOT_SCHEDULABLE; //Too long to check
+		if(nNext == w) break;
+		w = nNext;
+	}while(TRUE);
+	
+	t = w + 1; //Deadlines before t are checked
+	for(;;){
+		for(nNext = 0, i = 0; i < MAX_TASKS; i++){ //Last deadline before t
+			TCB* pTask = Tasks[i];
+			if(pTask && pTask->nPeriod && pTask->nRelDeadline < t){
+				uint d = (t - 1 - pTask->nRelDeadline) / pTask->nPeriod * pTask->nPeriod
+					+ pTask->nRelDeadline;
+				if(d > nNext) nNext = d;
+			}
+		}
+		if(!nNext) return OK; //No deadline left
+		t = nNext;
+		h = demand(t);
+		while(h < t && h > nMin){ //Skip to the demand, no deadline in between can fail
+			if(++nSteps > ADMIT_STEPS) return NOT_SCHEDULABLE;
+			t = h;
+			h = demand(t);
+		}
+		if(++nSteps > ADMIT_STEPS) return NOT_SCHEDULABLE;
+		if(h > t) return NOT_SCHEDULABLE;
+		if(h <= nMin) return OK;
+		//h == t, go on with the deadline before t
+	}
+}
+
+void dispatch(TCB* pNext){
+	//Make pNext Running. The run time of the task that ran is
+	//added up to now, also when it goes on running after a tick
+	//so that the time between two stamps stays short.
+	uint nNow = timer0_stamp(tickCounter);
+	if(Running){
+		Running->Stat.nRun += nNow - Running->nStamp;
+		if(Running != pNext && Running->Node.pList == List.ready)
+			Running->Stat.nPreemptions++; //Still ready, switched away from
+	}
+	if(Running != pNext)
+		pNext->Stat.nDispatches++;
+	pNext->bStarted = TRUE;
+	pNext->nStamp = nNow;
+	Running = pNext;
+}
+
+TCB* next_task(void){
+	//The task to run: the first one in the Readylist, unless a
+	//locked mutex keeps it from starting (SRP). A task that has
+	//not started since it became ready may only start if its
+	//relative deadline is shorter than the ceiling of every
+	//locked mutex. If it may not, the earliest deadline task
+	//that has started runs, one of them holds the mutex.
+	TCB* pNext = first(List.ready)->pTask;
+	TCB* pStarted = NULL;
+	uint i;
+	if(!pLocked || pNext->bStarted || pNext->nLevel < nSystemCeiling) return pNext;
+	for(i = 0; i < MAX_TASKS; i++){
+		TCB* pTask = Tasks[i];
+		if(pTask && pTask->bStarted && pTask->Node.pList == List.ready
+		   && (!pStarted || pTask->DeadLine < pStarted->DeadLine))
+			pStarted = pTask;
+	}
+	return pStarted ? pStarted : pNext;
+}
+
+uint* list_ticks(TCB* pTask, list* mylist){
+	//Stat counter of the time pTask spends in mylist
+	if(mylist == List.ready) return &pTask->Stat.nReady;
+	if(mylist == List.waiting) return &pTask->Stat.nWaiting;
+	return &pTask->Stat.nTimer;
+}
+
+exception block_on(waitq* pQueue, const char* pCall){
+	//Queue the calling task last on a semaphore or event group
+	//and block it in the Waitinglist. Called with interrupts
+	//off. release() takes it off the queue, at its deadline
+	//TimerInt() moves it back to the Readylist still queued.
+	TCB* pTask = Running;
+	pTask->pWaitOn = pQueue;
+	pTask->pWaitNext = NULL;
+	pTask->pWaitPrev = pQueue->pLast;
+	if(pQueue->pLast) pQueue->pLast->pWaitNext = pTask;
+	else pQueue->pFirst = pTask;
+	pQueue->pLast = pTask;
+	insert(List.waiting, extract(&pTask->Node)); //Move calling task from Readylist to Waitinglist
+	SwitchContext(); //Switch task, returns when the calling task runs again
+	pTask = Running;
+	isr_off_in(pCall); //Disable interrupt, a signal could release it meanwhile
+	if(pTask->pWaitOn){ //IF still queued THEN deadline is reached
+		release(pTask); //Off the queue, it is already in the Readylist
+		pTask->Stat.nMisses++;
+		isr_on(); //Enable interrupt
+		return DEADLINE_REACHED;
+	} //ENDIF
+	isr_on(); //Enable interrupt
+	return OK;
+}
+
+void wake_deferred(void){
+	//Move the consumers that channel_send_isr() woke from the
+	//Waitinglist to the Readylist. Interrupts disabled. A
+	//consumer that has already taken the items, after its
+	//deadline, stays blocked on its next wait.
+	channel* pChan;
+	while((pChan = pWakeList) != NULL){
+		TCB* pTask = pChan->pWaiter;
+		pWakeList = pChan->pNextWake;
+		pChan->bWake = FALSE;
+		if(pTask && pChan->nHead != pChan->nTail && pTask->Node.pList == List.waiting){
+			pChan->pWaiter = NULL;
+			insert(List.ready, extract(&pTask->Node));
+		}
+	}
+}
+
+void release(TCB* pTask){
+	//Take a task off the waitq it is blocked on and make it
+	//ready, O(1). Called with interrupts off.
+	waitq* pQueue = pTask->pWaitOn;
+	if(pTask->pWaitPrev) pTask->pWaitPrev->pWaitNext = pTask->pWaitNext;
+	else pQueue->pFirst = pTask->pWaitNext;
+	if(pTask->pWaitNext) pTask->pWaitNext->pWaitPrev = pTask->pWaitPrev;
+	else pQueue->pLast = pTask->pWaitPrev;
+	pTask->pWaitOn = NULL;
+	if(pTask->Node.pList == List.waiting)
+		insert(List.ready, extract(&pTask->Node));
+}
+
+uint KeepRunning(void){
+	//Fast path for calls that do not block. If the calling task
+	//is still first in the Readylist there is nothing to switch
+	//to: program the timer, enable interrupts and return TRUE,
+	//the caller returns without SwitchContext.
+	if(next_task() != Running) return FALSE;
+	program_shot();
+	isr_on(); //Enable interrupts
+	return TRUE;
+}
+
+void program_shot(void){
+	//Tickless: program the timer for the next event, the earliest
+	//Timerlist expiry or Waitinglist deadline. Runs with interrupts
+	//off, from TimerInt() or mid-tick from the kernel API.
+#ifdef TICKLESS
+	uint nNext = tw_next(List.timer->pWheel);
+	uint nElapsed = timer0_elapsed();
+	if(first(List.waiting) && first(List.waiting)->pTask->DeadLine < nNext)
+		nNext = first(List.waiting)->pTask->DeadLine;
+	if(nNext > tickCounter + nElapsed)
+		nShotTicks = nNext - tickCounter;
+	else
+		nShotTicks = nElapsed + 1; //Already due, take the next tick
+	if(nShotTicks > TIMER0_MAX_TICKS)
+		nShotTicks = TIMER0_MAX_TICKS;
+	timer0_oneshot(nShotTicks);
+#endif
+}
+
 /******************************************************************************\
                                   TASKS
 \******************************************************************************/
@@ -559,114 +1798,150 @@ void idle(void){
 // dlist.c
 // #include "dlist.h"
 
-list* create_List(){
-	TCB* task;
+list* create_DeadlineList(){
+	//Readylist and Waitinglist, kept in deadline order by the
+	//backend selected with READYQ, see readyq.c
 	list* mylist = (list *)calloc(1, sizeof(list));
 	if (!mylist) {
 		return NULL;
 	}
-	task = create_TCB(0, head);
-	if(!task) return NULL;
-	mylist->pHead = create_Listobj(task);
-	if (!mylist->pHead) {
+	mylist->pQueue = create_readyq(MAX_TASKS);
+	if (!mylist->pQueue) {
 		free(mylist);
 		return NULL;
 	}
-	
-	task = create_TCB(UINT_MAX, tail);
-	if(!task) return NULL;
-	mylist->pTail = create_Listobj(task);
-	if (!mylist->pTail) {
-		deleteListobj(mylist->pHead);
+	return mylist;
+}
+
+list* create_TimerList(){
+	//Timerlist, kept in a timing wheel on nTCnt, see twheel.c
+	list* mylist = (list *)calloc(1, sizeof(list));
+	if (!mylist) {
+		return NULL;
+	}
+	mylist->pWheel = create_twheel(tickCounter);
+	if (!mylist->pWheel) {
 		free(mylist);
 		return NULL;
 	}
-	mylist->pHead->nTCnt = UINT_MAX;
-	mylist->pTail->nTCnt = UINT_MAX;
-
-	mylist->pHead->pPrevious = mylist->pHead;
-	mylist->pHead->pNext = mylist->pTail;
-	mylist->pTail->pPrevious = mylist->pHead;
-	mylist->pTail->pNext = mylist->pTail;
 	return mylist;
 }
 
-TCB* create_TCB(uint deadline, void(*task_body)()){
-	TCB* pTask = (TCB*)calloc(1, sizeof(TCB));
+TCB* create_TCB(uint nStackSize){
+	//The list item is part of the TCB, the stack comes from the
+	//stack area and is filled with STACK_FILL
+	uint i;
+	TCB* pTask = (TCB*)pool_alloc(&Pools[POOL_TCB]);
 	if(!pTask) return NULL;
-	pTask->SPSR = 0; 
-	pTask->PC = task_body;
-	pTask->SP = &(pTask->StackSeg[STACK_SIZE-1]);	
-	pTask->DeadLine = deadline;
-	return pTask;
-}
-
-listobj* create_Listobj(TCB* task){
-	listobj* myobj = (listobj *)calloc(1, sizeof(listobj));
-	if (!myobj){
+	pTask->pStack = (uint*)tlsf_alloc(&StackHeap, nStackSize * sizeof(uint));
+	if(!pTask->pStack){
+		pool_free(&Pools[POOL_TCB], pTask);
 		return NULL;
 	}
-	myobj->pTask = task;
-	//myobj->nTCnt = tickCounter;
-	return (myobj);
+	for(i = 0; i < nStackSize; i++)
+		pTask->pStack[i] = STACK_FILL;
+	pTask->nStackSize = nStackSize;
+	pTask->nId = pool_index(&Pools[POOL_TCB], pTask);
+	pTask->Node.pTask = pTask;
+	Tasks[pTask->nId] = pTask;
+	return pTask;
 }
 
 msg* create_msg(){
-	msg* message = (msg*)calloc(1 ,sizeof(msg));
+	msg* message = (msg*)pool_alloc(&Pools[POOL_MSG]);
 	if(!message) return NULL;
 	return message;
 }
 
 char* create_data(void* data, uint size_t){
-	char* obj = (char*)calloc(1 ,size_t);
+	char* obj = (char*)tlsf_alloc(&Heap, size_t);
 	if(!obj) return NULL;
 	if(data) memcpy(obj, data, size_t);
+	else memset(obj, 0, size_t);
 	return obj;
 }
 
 void insert(list* mylist, listobj* pObj){
 	if(pObj){ // if there's an object
-		// insert first in list or...
-		listobj* pMarker;
-		pMarker = mylist->pHead;
+		pObj->pList = mylist;
+		pObj->pTask->nSince = NOW();
+		if(mylist != List.ready) pObj->pTask->bStarted = FALSE; //Blocked, starts again when released
+		TRACE_EVENT(TR_INSERT, pObj->pTask, NULL, trace_list(mylist));
 		
-		if(mylist == List.ready || mylist == List.waiting){ //sort on Deadline
-			while(pMarker != List.ready->pTail && pMarker != List.waiting->pTail && pMarker->pNext->pTask->DeadLine < pObj->pTask->DeadLine)
-				pMarker = pMarker->pNext;
-		}else if(mylist == List.timer){ //sort on nTCnt
-			while(pMarker->pNext->nTCnt < pObj->nTCnt)
-				pMarker = pMarker->pNext;
-		}
-		
-		/* Position found, insert element */
-		pObj->pNext = pMarker->pNext;
-		pObj->pPrevious = pMarker;
-		pMarker->pNext = pObj;
-		pObj->pNext->pPrevious = pObj;
+		if(mylist->pQueue) //sort on Deadline
+			rq_insertObj(mylist->pQueue, pObj);
+		else //Timing wheel on nTCnt
+			tw_insertObj(mylist->pWheel, pObj);
 	}
 }
 
 listobj* extract(listobj* pObj){
-	if(pObj->pPrevious == pObj || pObj->pNext == pObj) // No picking head/tail
+	if(!pObj->pList) // Not in a list
 		return NULL;
-	pObj->pPrevious->pNext = pObj->pNext;
-	pObj->pNext->pPrevious = pObj->pPrevious;
-	pObj->pNext = pObj->pPrevious = NULL;
+	if(pObj->pList->pQueue)
+		rq_extractObj(pObj->pList->pQueue, pObj);
+	else
+		tw_extractObj(pObj->pList->pWheel, pObj);
+	TRACE_EVENT(TR_EXTRACT, pObj->pTask, NULL, trace_list(pObj->pList));
+	*list_ticks(pObj->pTask, pObj->pList) += NOW() - pObj->pTask->nSince;
+	pObj->pList = NULL;
 	
 	return pObj;
 }
 
+void insertChain(list* mylist, listobj* pFirst){
+	//Insert a batch of items linked through pNext
+	listobj* pObj;
+	if(mylist->pQueue){
+		uint nNow = NOW();
+		for(pObj = pFirst; pObj; pObj = pObj->pNext){
+			if(pObj->pList){ //Released by tw_advance(), still marked as in the Timerlist
+				TRACE_EVENT(TR_EXTRACT, pObj->pTask, NULL, trace_list(pObj->pList));
+				*list_ticks(pObj->pTask, pObj->pList) += nNow - pObj->pTask->nSince;
+			}
+			pObj->pList = mylist;
+			pObj->pTask->nSince = nNow;
+			TRACE_EVENT(TR_INSERT, pObj->pTask, NULL, trace_list(mylist));
+		}
+		rq_insertChain(mylist->pQueue, pFirst);
+	}else{
+		while(pFirst){
+			pObj = pFirst->pNext;
+			insert(mylist, pFirst);
+			pFirst = pObj;
+		}
+	}
+}
+
+listobj* first(list* mylist){
+	//First item of a list, NULL if empty. Not for the Timerlist.
+	return rq_first(mylist->pQueue);
+}
+
 exception msg_insertObj(mailbox *mBox, msg *pObj){ 
-	if(mBox->nMaxMessages == mBox->nMessages) //IF mailbox is full THEN
-		deleteMessage(msg_extractObj(mBox, NULL)); //Remove the oldest Message struct
+	msg* pNext = mBox->pTail;
+	if(mBox->nMaxMessages == mBox->nMessages){ //IF mailbox is full THEN
+		msg* pOldest = mBox->pHead->pNext;
+		while(pOldest != mBox->pTail && pOldest->Status != 4) //Blocked tasks own theirs
+			pOldest = pOldest->pNext;
+		if(pOldest == mBox->pTail) return FAIL; //Only blocked tasks, refuse
+		msg_extractObj(mBox, pOldest); //Remove the oldest send_no_wait Message struct
+		deleteData(pOldest->pData); //and its copy of the data
+		deleteMessage(pOldest);
+	}
 	
 	if(pObj->Status != 4){ //F ndrat
-		pObj->pBlock = List.ready->pHead->pNext; 
-		List.ready->pHead->pNext->pMessage = pObj; 
+		pObj->pBlock = &Running->Node; 
+		Running->Node.pMessage = pObj; 
+		//Blocked tasks wait in deadline order, equal deadlines
+		//and send_no_wait Messages in arrival order
+		while(pNext->pPrevious != mBox->pHead && pNext->pPrevious->Status != 4
+		      && pNext->pPrevious->pBlock->pTask->DeadLine > Running->DeadLine)
+			pNext = pNext->pPrevious;
 	}
-	pObj->pNext = mBox->pTail;
-	pObj->pPrevious = mBox->pTail->pPrevious;
-	mBox->pTail->pPrevious = pObj;
+	pObj->pNext = pNext;
+	pObj->pPrevious = pNext->pPrevious;
+	pNext->pPrevious = pObj;
 	pObj->pPrevious->pNext = pObj;
 	
 	switch(pObj->Status){
@@ -693,13 +1968,136 @@ exception msg_insertObj(mailbox *mBox, msg *pObj){
 	return OK;
 }
 
+void unblock(msg* message){
+	//Make the task blocked by a send_wait or receive_wait
+	//Message ready, its Message has been taken. Interrupts
+	//disabled.
+	message->pBlock->pMessage = NULL; //Delivered
+	insert(List.ready, extract(message->pBlock));
+}
+
+void block_msg(listobj* pObj, uint nTicks){
+	//Block the calling task on its Message, until its deadline
+	//in the Waitinglist or with a limit in the Timerlist,
+	//which then stands for both. Interrupts disabled.
+	uint nExpire = NOW() + nTicks;
+	if(!nTicks){
+		insert(List.waiting, pObj);
+		return;
+	}
+	if(nExpire > pObj->pTask->DeadLine || nExpire < NOW()) nExpire = pObj->pTask->DeadLine;
+	pObj->nTCnt = nExpire;
+	insert(List.timer, pObj);
+}
+
+exception end_msg_wait(mailbox* mBox, uint nTicks, const char* pCall){
+	//After a blocking mailbox call. If its Message was not
+	//taken the deadline or the limit was reached: remove the
+	//Message from the mailbox and say which.
+	msg* message;
+	exception status = DEADLINE_REACHED;
+	isr_off_in(pCall); //Disable interrupt, a sender or receiver could take it meanwhile
+	message = Running->Node.pMessage;
+	if(!message){ //Delivered, or never blocked
+		isr_on(); //Enable interrupt
+		return OK;
+	}
+	if(nTicks && NOW() < Running->DeadLine){ //IF the limit came first THEN
+		TRACE_EVENT(TR_TIMEOUT, Running, mBox, 0);
+		status = TIMEOUT;
+	}else{ //ELSE
+		TRACE_EVENT(TR_DEADLINE, Running, mBox, 0);
+		Running->Stat.nMisses++;
+	} //ENDIF
+	msg_extractObj(mBox, message); //Clean up mailbox entry
+	if(message->Status == 2) deleteData(message->pData); //Free the copy of the data, a receivers pData is its own buffer
+	deleteMessage(message);
+	Running->Node.pMessage = NULL;
+	isr_on(); //Enable interrupt
+	return status;
+}
+
+exception msg_put(mailbox *mBox, void *pData){
+	//One send_no_wait Message, interrupts disabled.
+	if(mBox->nBlockedMsg < 0){//IF receiving task is waiting THEN
+		msg* message;
+		memcpy(mBox->pHead->pNext->pData, pData, mBox->nDataSize); //Copy data to receiving tasks data area.
+		message = msg_extractObj(mBox,NULL); //Remove receiving tasks Message struct from the mailbox
+		unblock(message); //Move receiving task to Readylist
+		deleteMessage(message);
+	}else if(mBox->pRing){ //ELSE IF ring mode THEN
+		ring_put(mBox, pData); //Copy Data to the next slot, the oldest is overwritten if full
+	}else{ //ELSE
+		msg* message = create_msg();//Allocate a Message structure
+		if(!message) return FAIL;
+		message->pData = create_data(pData, mBox->nDataSize); //Copy Data to the Message
+		if(!message->pData){										//Fun fact, skapar vi data crashar allt fr nTest
+			deleteMessage(message);
+			return FAIL;
+		}
+		message->Status = 4;
+		if(msg_insertObj(mBox, message) != OK){ //Add Message to the mailbox, the oldest is overwritten if full
+			deleteData(message->pData); //Full of blocked tasks
+			deleteMessage(message);
+			return FAIL;
+		}
+	} //ENDIF
+	return OK;
+}
+
+exception msg_get(mailbox *mBox, void *pData){
+	//One receive_no_wait Message, interrupts disabled. FAIL if
+	//no send Message is waiting.
+	if(mBox->nRingCount > 0){ //IF Message is buffered in the ring THEN
+		ring_get(mBox, pData); //Copy the oldest one to receiving tasks data area
+	}else if(mBox->nMessages > 0 && mBox->pHead->pNext->Status != 3){ //IF send Message is waiting THEN //Borde det inte bara kolla om det finns en send  //F ndrat
+		msg* message;
+		memcpy(pData, mBox->pHead->pNext->pData, mBox->nDataSize); //Copy senders data to receiving tasks data area
+		message = msg_extractObj(mBox, NULL); //Remove sending tasks Message struct from the mailbox
+		if(message->pBlock != NULL){ //IF Message was of wait type THEN
+			unblock(message);// Move sending task to Readylist
+		} //ENDIF
+		deleteData(message->pData); //Free senders data area
+		deleteMessage(message);
+	}else{ //ELSE
+		return FAIL;
+	} //ENDIF
+	return OK;
+}
+
+void ring_put(mailbox *mBox, void *pData){
+	//Buffer a send_no_wait Message in the ring, dropping the
+	//oldest one if the ring is full
+	int nSlot;
+	if(mBox->nRingCount == mBox->nMaxMessages){
+		if(mBox->bBuffers) //The dropped buffer is owned by the mailbox
+			deleteData(*(char**)(mBox->pRing + mBox->nRingFirst * mBox->nDataSize));
+		if(++mBox->nRingFirst == mBox->nMaxMessages) mBox->nRingFirst = 0;
+		mBox->nRingCount--;
+		mBox->nMessages--;
+	}
+	nSlot = mBox->nRingFirst + mBox->nRingCount;
+	if(nSlot >= mBox->nMaxMessages) nSlot -= mBox->nMaxMessages;
+	memcpy(mBox->pRing + nSlot * mBox->nDataSize, pData, mBox->nDataSize);
+	mBox->nRingCount++;
+	mBox->nMessages++;
+}
+
+void ring_get(mailbox *mBox, void *pData){
+	//Take the oldest Message from the ring, nRingCount > 0
+	memcpy(pData, mBox->pRing + mBox->nRingFirst * mBox->nDataSize, mBox->nDataSize);
+	if(++mBox->nRingFirst == mBox->nMaxMessages) mBox->nRingFirst = 0;
+	mBox->nRingCount--;
+	mBox->nMessages--;
+}
+
 msg *msg_extractObj(mailbox *mBox, msg *specific){ 
 	msg *temp;
 	temp = mBox->pHead->pNext;
 	
 	if(mBox->nMessages != 0 || mBox->nBlockedMsg != 0){
 		if(specific != NULL){ 
-			temp = specific->pBlock->pMessage;
+			temp = specific;
 		}
 		temp->pPrevious->pNext = temp->pNext;
 		temp->pNext->pPrevious =  temp->pPrevious;
@@ -737,31 +2135,30 @@ msg *msg_extractObj(mailbox *mBox, msg *specific){
                                  deconstructors
 \******************************************************************************/
 
-void deleteList(list* obj){
-	deleteListobj(obj->pHead);
-	deleteListobj(obj->pTail);
-	free(obj);
-}
-
 void deleteListobj(listobj* obj){
-	deleteTCB(obj->pTask);
-	free(obj);
+	deleteTCB(obj->pTask); //The item is part of the TCB
 }
 
 void deleteMailbox(mailbox* mBox){
 	deleteMessage(mBox->pHead);
 	deleteMessage(mBox->pTail);
-	free(mBox);
+	deleteData(mBox->pRing);
+	pool_free(&Pools[POOL_MAILBOX], mBox);
 }
 
 void deleteMessage(msg* message){
-	//free(message->pData);
-	free(message);
+	pool_free(&Pools[POOL_MSG], message);
 }
 void deleteData(char *data){
-	free(data);
+	tlsf_free(&Heap, data);
 }
 
 void deleteTCB(TCB* TaskContext){
-	free(TaskContext);
+	if(TaskContext->nPeriod){ //Out of the admission sums
+		nUtilisation -= utilisation(TaskContext);
+		if(TaskContext->nRelDeadline < TaskContext->nPeriod) nConstrained--;
+	}
+	Tasks[TaskContext->nId] = NULL;
+	tlsf_free(&StackHeap, TaskContext->pStack);
+	pool_free(&Pools[POOL_TCB], TaskContext);
 }
@@ -4,6 +4,23 @@
 // Debug option
 //#define       _DEBUG
 
+// Tickless option, the timer is only programmed for the next event
+// instead of interrupting every tick
+//#define       TICKLESS
+
+// Trace option, scheduler events are recorded in a ring buffer,
+// see trace.h
+//#define       TRACE
+
+// Soft interrupt option, TimerInt() walks the lists with interrupts
+// on. The tick interrupt must be able to nest in it, as on the host
+// port, see TimerInt()
+//#define       SOFTIRQ
+
+// Interrupts-off statistics option, the time and calling kernel
+// function of each window with interrupts off, see isrstat.h
+//#define       ISR_STATS
+
 /*********************************************************/
 /** Global variabels and definitions                     */
 /*********************************************************/
@@ -16,7 +33,51 @@
 #else
 
 #define CONTEXT_SIZE    13 
-#define STACK_SIZE      100
+#ifndef STACK_SIZE
+#define STACK_SIZE      100     // Words, stack of create_task()
+#endif
+#ifndef IDLE_STACK_SIZE
+#define IDLE_STACK_SIZE 32      // Words, stack of the idle task
+#endif
+#endif
+
+#ifndef MAX_TASKS
+#define MAX_TASKS       32      // Maximum number of tasks, idle included
+#endif
+#ifndef MAX_MAILBOXES
+#define MAX_MAILBOXES   16
+#endif
+#ifndef MAX_MUTEXES
+#define MAX_MUTEXES     8
+#endif
+#ifndef MAX_SEMAPHORES
+#define MAX_SEMAPHORES  8
+#endif
+#ifndef MAX_EVENTS
+#define MAX_EVENTS      8       // Event flag groups
+#endif
+#ifndef MAX_CHANNELS
+#define MAX_CHANNELS    4       // Interrupt to task channels
+#endif
+#ifndef MAX_MESSAGES
+#define MAX_MESSAGES    64      // Message structs, 2 per mailbox go to head/tail
+#endif
+#ifndef HEAP_SIZE
+#define HEAP_SIZE       4096    // Bytes for buffered message data, see tlsf.c
+#endif
+#ifndef STACK_AREA
+#define STACK_AREA      (MAX_TASKS * (STACK_SIZE + 4) * 4)      // Bytes for task stacks
+#endif
+#define STACK_FILL      0xDEADBEEF      // Unused stack words
+
+// Backend for the deadline sorted lists (Readylist and Waitinglist),
+// see readyq.c. Select with -DREADYQ=READYQ_xxx.
+#define READYQ_LIST     0       // Sorted linked list, O(n) insert
+#define READYQ_HEAP     1       // Binary min-heap on DeadLine, O(log n)
+#define READYQ_BITMAP   2       // Deadline buckets + find-first-set, O(1)
+                                // within the window, O(overflow) on refill
+#ifndef READYQ
+#define READYQ          READYQ_HEAP
 #endif
 
 #define TRUE    1
@@ -31,6 +92,13 @@
 
 #define DEADLINE_REACHED        0
 #define NOT_EMPTY               0
+#define NOT_SCHEDULABLE         -1      // create_periodic_task() would overload the CPU
+#define TIMEOUT                 -2      // The limit of a xxx_wait_timeout() call ran out
+
+// wait_event() modes
+#define EVENT_ANY       0       // Released by any flag of the mask
+#define EVENT_ALL       1       // Released when all flags of the mask are set
+#define EVENT_CLEAR     2       // Or-ed in: clear the mask flags on release
 
 #define SENDER          +1
 #define RECEIVER        -1
@@ -42,26 +110,10 @@ typedef unsigned int    uint;
 typedef int 			action;
 
 struct  l_obj;         // Forward declaration
-
-// Task Control Block, TCB
-#ifdef texas_dsp
-typedef struct{
-	void	(*PC)();
-	uint	*SP;
-	uint	Context[CONTEXT_SIZE];
-	uint	StackSeg[STACK_SIZE];
-	uint	DeadLine;
-} TCB;
-#else
-typedef struct{
-        uint    Context[CONTEXT_SIZE];        
-        uint    *SP;
-        void    (*PC)();
-        uint    SPSR;     
-        uint    StackSeg[STACK_SIZE];
-        uint    DeadLine;
-} TCB;
-#endif
+struct  tcb;
+struct  l_list;
+struct  rq;
+struct  tw;
 
 // Message items
 typedef struct msgobj {
@@ -80,21 +132,180 @@ typedef struct {
         int             nMaxMessages;
         int             nMessages;
         int             nBlockedMsg;
+        char            *pRing;         // Ring mode: nMaxMessages slots of nDataSize bytes
+        int             nRingFirst;     // Slot of the oldest buffered Message
+        int             nRingCount;
+        bool            bBuffers;       // Messages are buffers from create_buffer()
+        uint            nId;            // Pool slot, see trace.h
 } mailbox;
 
+// Mutex of the Stack Resource Policy, see create_mutex()
+typedef struct mtx {
+        uint            nCeiling;       // Shortest relative deadline of the tasks locking it
+        struct tcb      *pOwner;        // NULL if free
+        struct mtx      *pBelow;        // Mutex locked before it
+        uint            nPrevCeiling;   // System ceiling before it was locked
+} mutex;
+
+// Tasks blocked on a semaphore or an event group, in arrival order,
+// linked through TCB::pWaitNext
+typedef struct {
+        struct tcb      *pFirst;
+        struct tcb      *pLast;
+} waitq;
+
+// Counting semaphore, see create_semaphore()
+typedef struct {
+        uint            nCount;
+        waitq           Waiters;
+} semaphore;
+
+// Event flag group, see create_event()
+typedef struct {
+        uint            nFlags;
+        waitq           Waiters;
+} eventgroup;
+
+// Single producer, single consumer ring from an interrupt handler to
+// a task, see create_channel(). Each index is written by one side only.
+// The handlers that send on channels must not nest, see
+// channel_send_isr().
+typedef struct chan {
+        char            *pRing;         // Slots of nDataSize bytes
+        uint            nMask;          // Slots - 1, slots a power of two
+        uint            nDataSize;
+        volatile uint   nHead;          // Items put, producer
+        volatile uint   nTail;          // Items taken, consumer
+        volatile uint   nLost;          // Items dropped on a full ring
+        struct tcb      *volatile pWaiter;      // Consumer blocked on it
+        volatile bool   bWake;          // In the deferred wake list
+        struct chan     *pNextWake;
+} channel;
+
 // Generic list item
 typedef struct l_obj {
-         TCB            *pTask;
+         struct l_obj   *pPrevious;     // Links first, next to TCB::DeadLine
+         struct l_obj   *pNext;
+         struct tcb     *pTask;
          uint           nTCnt;
+         struct l_list  *pList;         // List the item is in, NULL if none
+         uint           nIndex;         // Backend position, see readyq.c
          msg            *pMessage;
-         struct l_obj   *pPrevious;
-         struct l_obj   *pNext;
 } listobj;
 
-// Generic list
+// Task run time and scheduling counters, see task_stats(). The list
+// times are in ticks, the Readylist time includes the run time.
+typedef struct {
+        unsigned long long nRun;        // Counts of timer0_stamp() running
+        uint            nDispatches;    // Times the task was loaded
+        uint            nPreemptions;   // Switched away from while ready
+        uint            nReady;         // Ticks in the Readylist
+        uint            nWaiting;       // Ticks in the Waitinglist
+        uint            nTimer;         // Ticks in the Timerlist
+        uint            nMisses;        // Blocking calls that gave DEADLINE_REACHED
+        uint            nReleases;      // Periods started by wait_until()
+        uint            nJitter;        // Of the last release, timer0_count() counts
+        uint            nJitterMax;
+} taskstat;
+
+// Task Control Block, TCB. The saved context stays at the offsets
+// used by context.s79, the fields used by the scheduler follow it
+// and the list item is part of the TCB. The stack is kept elsewhere.
+#ifdef texas_dsp
+typedef struct tcb {
+	void	(*PC)();
+	uint	*SP;
+	uint	Context[CONTEXT_SIZE];
+	uint	DeadLine;
+	listobj	Node;
+	uint	*pStack;
+	uint	nStackSize;
+	uint	nId;
+	taskstat	Stat;
+	uint	nStamp;
+	uint	nSince;
+	uint	nWcet;
+	uint	nPeriod;
+	uint	nRelDeadline;
+	uint	nRelease;
+	uint	nLevel;
+	bool	bStarted;
+	struct tcb	*pWaitNext;
+	struct tcb	*pWaitPrev;
+	waitq	*pWaitOn;
+	uint	nWaitMask;
+	uint	nWaitMode;
+} TCB;
+#else
+typedef struct tcb {
+        uint    Context[CONTEXT_SIZE];        
+        uint    *SP;
+        void    (*PC)();
+        uint    SPSR;     
+        uint    LoadCPSR;       // LoadContext restores CPSR from here if not 0
+        uint    DeadLine;
+        listobj Node;           // Readylist, Waitinglist or Timerlist item
+        uint    *pStack;        // Lowest word of the stack
+        uint    nStackSize;     // Words
+        uint    nId;            // See task_id()
+        taskstat Stat;          // See task_stats()
+        uint    nStamp;         // timer0_stamp() when Stat.nRun was last updated
+        uint    nSince;         // Tick the task entered its list
+        uint    nWcet;          // Ticks, see create_periodic_task()
+        uint    nPeriod;        // Ticks, 0 if not periodic
+        uint    nRelDeadline;   // Ticks from the start of each period
+        uint    nRelease;       // Tick the current period started
+        uint    nLevel;         // Preemption level as a relative deadline, see create_mutex()
+        bool    bStarted;       // Has run since it last entered the Readylist
+        struct tcb *pWaitNext;  // Semaphore or event group waitq
+        struct tcb *pWaitPrev;
+        waitq   *pWaitOn;       // NULL once released
+        uint    nWaitMask;      // wait_event(), the flags it was released by after
+        uint    nWaitMode;
+} TCB;
+#endif
+
+// Kernel object pool statistics
+#define POOL_TCB        0
+#define POOL_MSG        1
+#define POOL_MAILBOX    2
+#define POOL_MUTEX      3
+#define POOL_SEMAPHORE  4
+#define POOL_EVENT      5
+#define POOL_CHANNEL    6
+#define NOF_POOLS       7
+
+typedef struct {
+        uint            nSize;          // Object size in bytes
+        uint            nTotal;         // Objects in the pool
+        uint            nUsed;
+        uint            nPeak;          // Highest nUsed seen
+        uint            nExhausted;     // Allocations that failed
+} poolstat;
+
+// Message data heap statistics. Fragmentation of the free space is
+// 1 - nLargestFree / nFree.
+typedef struct {
+        uint            nSize;          // Arena bytes
+        uint            nUsed;          // Bytes in allocated blocks, headers included
+        uint            nPeak;          // Highest nUsed seen
+        uint            nFree;
+        uint            nLargestFree;   // Data bytes of the largest free block
+        uint            nExhausted;     // Allocations that failed
+} heapstat;
+
+// Task stack usage, in words
 typedef struct {
-         listobj        *pHead;
+        uint            nSize;
+        uint            nPeak;          // High-water mark
+} stackstat;
+
+// Generic list
+typedef struct l_list {
+         listobj        *pHead;         // dlist.c only, see test.c
          listobj        *pTail;
+         struct rq      *pQueue;        // Deadline queue, Readylist and Waitinglist
+         struct tw      *pWheel;        // Timing wheel, Timerlist
 } list;
 
 /*----------------------------------------------------------------------------*\
@@ -104,19 +315,66 @@ typedef struct {
 // Task administration
 int             init_kernel(void);
 exception	create_task( void (* body)(), uint d );
+exception       create_task_stack( void (* body)(), uint d, uint nStackSize );
+exception       create_periodic_task( void (* body)(), uint nWcet, uint nPeriod, uint nDeadline );
 void            terminate( void );
 void            run( void );
 
 // Communication
 mailbox*	create_mailbox( uint nMessages, uint nDataSize );
+mailbox*        create_ring_mailbox( uint nMessages, uint nDataSize );
 int             no_messages( mailbox* mBox );
 exception       send_wait( mailbox* mBox, void* pData );
 exception       receive_wait( mailbox* mBox, void* pData );
+exception       send_wait_timeout( mailbox* mBox, void* pData, uint nTicks );
+exception       receive_wait_timeout( mailbox* mBox, void* pData, uint nTicks );
 exception	send_no_wait( mailbox* mBox, void* pData );
 int             receive_no_wait( mailbox* mBox, void* pData );
+int             send_no_wait_n( mailbox* mBox, void* pData, uint nItems );
+int             receive_no_wait_n( mailbox* mBox, void* pData, uint nItems );
+mailbox*        create_buffer_mailbox( uint nMessages );
+void*           create_buffer( uint nSize );
+void            release_buffer( void* pBuffer );
+exception       send_buffer( mailbox* mBox, void* pBuffer );
+exception       receive_buffer( mailbox* mBox, void** ppBuffer );
+
+// Mutexes, Stack Resource Policy
+mutex*          create_mutex( uint nCeiling );
+exception       remove_mutex( mutex* pMutex );
+exception       lock_mutex( mutex* pMutex );
+exception       unlock_mutex( mutex* pMutex );
+
+// Semaphores and event flags
+semaphore*      create_semaphore( uint nCount );
+exception       remove_semaphore( semaphore* pSem );
+exception       wait_semaphore( semaphore* pSem );
+void            signal_semaphore( semaphore* pSem );
+eventgroup*     create_event( void );
+exception       remove_event( eventgroup* pEvent );
+exception       wait_event( eventgroup* pEvent, uint nMask, uint nMode, uint* pFlags );
+void            set_event( eventgroup* pEvent, uint nFlags );
+void            clear_event( eventgroup* pEvent, uint nFlags );
+
+// Interrupt to task channels
+channel*        create_channel( uint nSlots, uint nDataSize );
+exception       remove_channel( channel* pChan );
+exception       channel_send_isr( channel* pChan, void* pData );
+exception       channel_receive_wait( channel* pChan, void* pData );
+exception       channel_receive_no_wait( channel* pChan, void* pData );
+void            isr_exit( void );
+bool            isr_nested( void );
+
+// Kernel objects
+exception       pool_stats( uint nPool, poolstat* pStat );
+void            heap_stats( heapstat* pStat );
+uint            task_id( void );
+exception       task_stack_usage( uint nTask, stackstat* pStat );
+exception       task_stats( uint nTask, taskstat* pStat );
 
 // Timing
 exception	wait( uint nTicks );
+exception       wait_until( uint nTick );
+exception       wait_next_period( void );
 void            set_ticks( uint no_of_ticks );
 uint            ticks( void );
 uint		deadline( void );
@@ -127,5 +385,6 @@ extern void     isr_off(void);
 extern void     isr_on(void);
 extern void     SaveContext( void );	// Stores DSP registers in TCB pointed to by Running
 extern void     LoadContext( void );	// Restores DSP registers from TCB pointed to by Running
+extern void     SwitchContext( void );	// Stores callee-saved registers in Running and loads the next task
 
 #endif
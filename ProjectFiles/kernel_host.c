@@ -0,0 +1,197 @@
+/* kernel_host.c
+ * Host replacement for kernel_hwdep.c and the interrupt glue, so the
+ * kernel runs as one x86-64 Linux process, see the Makefile. The
+ * context switch itself is in context_host.S.
+ *
+ * Interrupts: isr_off()/isr_on() set and clear IsrOff, the I bit of
+ * the simulated CPU. LoadContext() clears it when it enters a task.
+ *
+ * Timer0: a periodic SIGALRM of TIMER0_TICK_US is the counter. It counts
+ * whole ticks since the last timer interrupt, as rTCNT0 does, and the
+ * interrupt is taken when the programmed shot has elapsed and IsrOff
+ * is clear. A tick that comes while IsrOff is set stays due and is
+ * taken by the next isr_on() or SIGALRM. Built with SOFTIRQ a tick
+ * that comes while TimerInt() walks the lists with interrupts on only
+ * calls TimerInt() to count it. timer0_count() is in TSC cycles since
+ * the last SIGALRM, timer0_stamp() is the TSC itself. The handler runs
+ * on the stack of the interrupted task and the signal frame holds all
+ * of its registers, so Timer0Int() only saves what a C call must
+ * preserve and a preempted task resumes by returning from the handler.
+ *
+ * The process exits when only the idle task is left. Built with TRACE
+ * it then writes the trace to the file named by KERNEL_TRACE, if set,
+ * and built with ISR_STATS the interrupts-off windows per kernel
+ * call to the file named by KERNEL_ISR_STATS, as text.
+ */
+#define _GNU_SOURCE
+#include "kernel.h"
+#include "kernel_hwdep.h"
+#include "twheel.h"
+#include "trace.h"
+#include "isrstat.h"
+#include <limits.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <x86intrin.h>
+
+// context_host.S reads the TCB at these offsets
+typedef char check_sp[offsetof(TCB, SP) == 56 ? 1 : -1];
+typedef char check_pc[offsetof(TCB, PC) == 64 ? 1 : -1];
+typedef char check_spsr[offsetof(TCB, SPSR) == 72 ? 1 : -1];
+typedef char check_context[sizeof(((TCB*)0)->Context) >= 6 * 8 ? 1 : -1];
+
+extern TCB* Running;
+extern struct threeLists{
+	list* waiting;
+	list* ready;
+	list* timer;
+}List;
+
+void TimerInt(void);
+listobj* first(list* mylist);
+void SaveContext(void) __attribute__((returns_twice)); //As setjmp
+
+volatile uint IsrOff = 1;               // Set until run() enables interrupts
+static volatile uint nElapsed;          // Ticks since the last timer interrupt
+static volatile uint nShot = 1;         // Ticks from the last interrupt to the next
+static volatile uint nTickTsc;          // TSC at the last SIGALRM
+static volatile uint nTscPerTick;       // Between the last two SIGALRMs
+static volatile uint InTick;            // In Timer0Int(), a tick now nests
+
+#define BARRIER()       __asm__ volatile("" ::: "memory")
+
+static void Timer0Int(void){
+	//Interrupts off. As the target ISR: save, TimerInt(), load.
+	volatile uint firstExecution = TRUE;
+	SaveContext();
+	if(firstExecution){
+		firstExecution = FALSE;
+		InTick = 1;
+		do{
+			__atomic_sub_fetch(&nElapsed, nShot, __ATOMIC_RELAXED);
+			TimerInt();
+		}while(nElapsed >= nShot);
+		if(first(List.ready)->pTask->DeadLine == UINT_MAX && !first(List.waiting)
+		   && !List.timer->pWheel->nCount)
+			exit(0); //Only the idle task is left
+		InTick = 0;
+		LoadContext();
+	}
+}
+
+#ifdef TRACE
+static void dump(void){
+	const char* pName = getenv("KERNEL_TRACE");
+	FILE* f;
+	if(!pName || !(f = fopen(pName, "wb"))) return;
+	trace_enable(FALSE);
+	fwrite(&Trace, sizeof(Trace), 1, f);
+	fclose(f);
+}
+#endif
+
+#ifdef ISR_STATS
+static void dump_isr_stats(void){
+	//One line per call: windows, mean and worst in TSC cycles,
+	//then the log2 histogram from bucket 0 to the last one used
+	static isrsite Sites[ISR_SITES];
+	const char* pName = getenv("KERNEL_ISR_STATS");
+	FILE* f;
+	uint i, b, n, nLast;
+	if(!pName || !(f = fopen(pName, "w"))) return;
+	n = isr_stats(Sites, ISR_SITES);
+	fprintf(f, "%-24s %10s %10s %10s  histogram\n", "call", "count", "mean", "max");
+	for(i = 0; i < n; i++){
+		isrsite* pSite = &Sites[i];
+		for(nLast = ISR_BUCKETS - 1; nLast && !pSite->Hist[nLast]; nLast--);
+		fprintf(f, "%-24s %10u %10llu %10u ", pSite->pName, pSite->nCount,
+			pSite->nCount ? pSite->nTotal / pSite->nCount : 0, pSite->nMax);
+		for(b = 0; b <= nLast; b++)
+			fprintf(f, " %u", pSite->Hist[b]);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+}
+#endif
+
+static void take_tick(void){
+	//IsrOff set. Nested in TimerInt(), SOFTIRQ, only count the tick.
+	if(InTick){
+		__atomic_sub_fetch(&nElapsed, nShot, __ATOMIC_RELAXED);
+		TimerInt();
+		IsrOff = 0;
+		return;
+	}
+	Timer0Int();
+}
+
+static void Tick(int nSig){
+	uint nTsc = (uint)__rdtsc();
+	(void)nSig;
+	if(nTickTsc) nTscPerTick = nTsc - nTickTsc;
+	nTickTsc = nTsc;
+	__atomic_add_fetch(&nElapsed, 1, __ATOMIC_RELAXED);
+	if(IsrOff || !Running || nElapsed < nShot) return;
+	IsrOff = 1;
+	take_tick();
+}
+
+void isr_off(void){
+	IsrOff = 1;
+	BARRIER();
+}
+
+void isr_on(void){
+	BARRIER();
+	IsrOff = 0;
+	if(Running && nElapsed >= nShot){ //Take a tick that came while off
+		IsrOff = 1;
+		take_tick();
+	}
+}
+
+void timer0_start(void){
+	struct sigaction sa;
+	struct itimerval it;
+	sa.sa_handler = Tick;
+	sigemptyset(&sa.sa_mask);
+	//The handler may never return to the signal frame it came from,
+	//so SIGALRM must not be blocked while it runs. IsrOff masks it.
+	sa.sa_flags = SA_RESTART | SA_NODEFER;
+	sigaction(SIGALRM, &sa, NULL);
+#ifdef TRACE
+	atexit(dump);
+#endif
+#ifdef ISR_STATS
+	atexit(dump_isr_stats);
+#endif
+	nElapsed = 0;
+	nShot = 1;
+	it.it_interval.tv_sec = 0;
+	it.it_interval.tv_usec = TIMER0_TICK_US;
+	it.it_value = it.it_interval;
+	setitimer(ITIMER_REAL, &it, NULL);
+}
+
+void timer0_oneshot(uint nTicks){
+	nShot = nTicks;
+}
+
+uint timer0_elapsed(void){
+	return nElapsed;
+}
+
+uint timer0_count(void){
+	return nTickTsc ? (uint)__rdtsc() - nTickTsc : 0; //0 until the first tick
+}
+
+uint timer0_tick_counts(void){
+	return nTscPerTick;
+}
+
+uint timer0_stamp(uint nTicks){
+	(void)nTicks;
+	return (uint)__rdtsc();
+}
@@ -38,7 +38,7 @@ void timer0_start(void)
  Internal clock 50 MHz -> Timer 0 period 25 ns - ~20 ms.
 See Prescale timer 8-9*/ 
   rTPRE0 = 0x3f;
-  rTDAT0 = 0x1e01;
+  rTDAT0 = TIMER0_TICK;
 
 /* "IRQ" - not "FIRQ" , Reset pp11-3*/
   rINTMOD = 0x00000000;	
@@ -48,3 +48,56 @@ Activate interrupt globally. Bit 6, GIE=1, pp15-6*/
   rINTMSK = 0x100; 
   rSYSCON |= 0x40;
 }
+
+/*-------------------------------------------------------------------------*/
+/* void timer0_oneshot( uint nTicks ) - Next interrupt nTicks ticks after  */
+/*	the last one. The counter keeps running from the last match, so   */
+/*	moving the match value does not lose the part of a tick already   */
+/*	counted. Used by the tickless kernel.				   */
+/* Argument: Ticks, 1..TIMER0_MAX_TICKS and later than timer0_elapsed()   */
+/*-------------------------------------------------------------------------*/
+
+void timer0_oneshot(unsigned int nTicks)
+{
+  rTDAT0 = nTicks * TIMER0_TICK;
+}
+
+/*-------------------------------------------------------------------------*/
+/* uint timer0_elapsed( void ) - Whole ticks counted since the last	   */
+/*	timer interrupt							   */
+/*-------------------------------------------------------------------------*/
+
+unsigned int timer0_elapsed(void)
+{
+  return rTCNT0 / TIMER0_TICK;
+}
+
+/*-------------------------------------------------------------------------*/
+/* uint timer0_count( void ) - Timer counts since the last timer	   */
+/*	interrupt, TIMER0_TICK per tick. Time stamps finer than a tick.	   */
+/*-------------------------------------------------------------------------*/
+
+unsigned int timer0_count(void)
+{
+  return rTCNT0;
+}
+
+/*-------------------------------------------------------------------------*/
+/* uint timer0_tick_counts( void ) - timer0_count() per tick		   */
+/*-------------------------------------------------------------------------*/
+
+unsigned int timer0_tick_counts(void)
+{
+  return TIMER0_TICK;
+}
+
+/*-------------------------------------------------------------------------*/
+/* uint timer0_stamp( uint nTicks ) - Time in timer counts, wraps, only	   */
+/*	differences are used. nTicks is the tick of the last timer	   */
+/*	interrupt.							   */
+/*-------------------------------------------------------------------------*/
+
+unsigned int timer0_stamp(unsigned int nTicks)
+{
+  return nTicks * TIMER0_TICK + rTCNT0;
+}
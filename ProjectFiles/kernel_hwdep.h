@@ -12,6 +12,13 @@
 #define rTDAT0 (*(volatile unsigned short*)(0x7ff9000))
 #define rTPRE0 (*(volatile unsigned char *)(0x7ff9002))/* Prescale timer 8-9, ~400 ms*/
 #define rTCON0 (*(volatile unsigned char *)(0x7ff9003))
+#define rTCNT0 (*(volatile unsigned short*)(0x7ff9006))/* Counter, restarts at match 8-6*/
+
+#define TIMER0_TICK      0x1e01                 /* Counts per tick, ~20 ms */
+#define TIMER0_MAX_TICKS (0xffff / TIMER0_TICK)  /* Longest one-shot in ticks */
+#ifndef TIMER0_TICK_US
+#define TIMER0_TICK_US   20000                  /* Microseconds per tick */
+#endif
 
 /*------------ Interrupt Control-------------- */
 #define rSYSCON (*(volatile unsigned char *)(0x7ffd003))
@@ -21,6 +28,12 @@
 
 //void Init_IRQ_TINT0(void);
 unsigned int set_isr( unsigned int newCSR );
+void timer0_start(void);
+void timer0_oneshot(unsigned int nTicks);
+unsigned int timer0_elapsed(void);
+unsigned int timer0_count(void);
+unsigned int timer0_tick_counts(void);
+unsigned int timer0_stamp(unsigned int nTicks);
 extern unsigned int Get_psr(void);
 extern void Set_psr(unsigned int PSR);
 
@@ -0,0 +1,53 @@
+// pool.c
+// Fixed-size object pools. The arena of each pool is allocated once
+// at init_kernel() time, after that pool_alloc()/pool_free() are O(1)
+// pops and pushes on an intrusive free list and never touch the heap.
+
+#include "pool.h"
+#include <string.h>
+
+exception pool_init(pool* p, uint nSize, uint nObjects){
+	//Carve the arena into nObjects free objects. Calling it again
+	//with the same geometry reuses the arena.
+	uint i;
+	nSize = (nSize + sizeof(void*) - 1) & ~(uint)(sizeof(void*) - 1);
+	if(!p->pArena || p->Stat.nSize != nSize || p->Stat.nTotal != nObjects){
+		free(p->pArena);
+		p->pArena = (char*)calloc(nObjects, nSize);
+		if(!p->pArena) return FAIL;
+	}
+	p->pFree = NULL;
+	for(i = nObjects; i-- > 0;){
+		*(void**)(p->pArena + i * nSize) = p->pFree;
+		p->pFree = p->pArena + i * nSize;
+	}
+	memset(&p->Stat, 0, sizeof(poolstat));
+	p->Stat.nSize = nSize;
+	p->Stat.nTotal = nObjects;
+	return OK;
+}
+
+void* pool_alloc(pool* p){
+	//A zeroed object, or NULL if the pool is exhausted
+	void* pObj = p->pFree;
+	if(!pObj){
+		p->Stat.nExhausted++;
+		return NULL;
+	}
+	p->pFree = *(void**)pObj;
+	memset(pObj, 0, p->Stat.nSize);
+	if(++p->Stat.nUsed > p->Stat.nPeak) p->Stat.nPeak = p->Stat.nUsed;
+	return pObj;
+}
+
+void pool_free(pool* p, void* pObj){
+	if(!pObj) return;
+	*(void**)pObj = p->pFree;
+	p->pFree = pObj;
+	p->Stat.nUsed--;
+}
+
+uint pool_index(pool* p, void* pObj){
+	//Slot of an object, 0 to nTotal-1, fixed while it is allocated
+	return (uint)(((char*)pObj - p->pArena) / p->Stat.nSize);
+}
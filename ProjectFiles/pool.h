@@ -0,0 +1,21 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "kernel.h"
+
+/*********************************************************/
+/** Fixed-size object pools for kernel objects            */
+/*********************************************************/
+
+typedef struct {
+        void            *pFree;         // Free objects, linked through their first word
+        char            *pArena;
+        poolstat        Stat;
+} pool;
+
+exception       pool_init( pool* p, uint nSize, uint nObjects );
+void*           pool_alloc( pool* p );
+void            pool_free( pool* p, void* pObj );
+uint            pool_index( pool* p, void* pObj );
+
+#endif
@@ -0,0 +1,339 @@
+// readyq.c
+// Deadline queues for the Readylist and Waitinglist. The backend is
+// chosen at build time with READYQ (see kernel.h):
+//   READYQ_LIST    sorted doubly linked list, O(n) insert, O(1) first
+//   READYQ_HEAP    binary min-heap, O(log n) insert/extract, O(1) first
+//   READYQ_BITMAP  circular window of RQ_BUCKETS deadline buckets, each
+//                  a range of 2^RQ_SHIFT ticks kept as a short sorted list,
+//                  found with a two level find-first-set. Deadlines beyond
+//                  the window go to an unsorted overflow list which is
+//                  pulled into the window when it runs empty. Insert and
+//                  extract are O(1) within the window; a refill walks the
+//                  whole overflow list and lowering the window walks up to
+//                  RQ_BUCKETS buckets. The idle task (deadline UINT_MAX)
+//                  sits in overflow, so the Readylist pays a refill each
+//                  time it drains to idle.
+// A new item is placed before items with an equal deadline where the
+// backend allows it, the same order as the original sorted list.
+// rq_insertChain() takes a batch of items linked through pNext, as
+// released by one timer tick. The heap appends the whole batch and
+// restores the heap order once.
+
+#include "readyq.h"
+#include <stdlib.h>
+
+#define KEY(pObj)       ((pObj)->pTask->DeadLine)
+
+#if READYQ == READYQ_HEAP
+
+static void rq_place(readyq* q, listobj* pObj, uint i){
+	q->pHeap[i] = pObj;
+	pObj->nIndex = i;
+}
+
+static void rq_siftUp(readyq* q, uint i){
+	listobj* pObj = q->pHeap[i];
+	while(i > 0){
+		uint parent = (i - 1) / 2;
+		if(KEY(q->pHeap[parent]) < KEY(pObj)) break;
+		rq_place(q, q->pHeap[parent], i);
+		i = parent;
+	}
+	rq_place(q, pObj, i);
+}
+
+static void rq_siftDown(readyq* q, uint i){
+	listobj* pObj = q->pHeap[i];
+	uint child;
+	while((child = 2 * i + 1) < q->nCount){
+		if(child + 1 < q->nCount && KEY(q->pHeap[child + 1]) < KEY(q->pHeap[child]))
+			child++;
+		if(!(KEY(q->pHeap[child]) < KEY(pObj))) break;
+		rq_place(q, q->pHeap[child], i);
+		i = child;
+	}
+	rq_place(q, pObj, i);
+}
+
+void rq_insertObj(readyq* q, listobj* pObj){
+	if(q->nCount == q->nCapacity) return; //Caller keeps within capacity
+	rq_place(q, pObj, q->nCount++);
+	rq_siftUp(q, pObj->nIndex);
+}
+
+void rq_extractObj(readyq* q, listobj* pObj){
+	uint i = pObj->nIndex;
+	listobj* pLast = q->pHeap[--q->nCount];
+	if(pLast != pObj){ //Move last item into the hole
+		rq_place(q, pLast, i);
+		if(i > 0 && KEY(pLast) < KEY(q->pHeap[(i - 1) / 2]))
+			rq_siftUp(q, i);
+		else
+			rq_siftDown(q, i);
+	}
+}
+
+listobj* rq_first(readyq* q){
+	return q->nCount ? q->pHeap[0] : NULL;
+}
+
+void rq_insertChain(readyq* q, listobj* pFirst){
+	//Append the batch, then either sift each item up or rebuild the
+	//heap bottom-up when the batch is large compared to the heap
+	uint nOld = q->nCount;
+	uint i;
+	while(pFirst && q->nCount < q->nCapacity){
+		listobj* pNext = pFirst->pNext;
+		rq_place(q, pFirst, q->nCount++);
+		pFirst = pNext;
+	}
+	if(q->nCount - nOld > nOld / 2){
+		for(i = q->nCount / 2; i-- > 0;)
+			rq_siftDown(q, i);
+	}else{
+		for(i = nOld; i < q->nCount; i++)
+			rq_siftUp(q, i);
+	}
+}
+
+#elif READYQ == READYQ_BITMAP
+
+#define RQ_MASK         ((1U << RQ_SHIFT) - 1)
+
+static uint rq_ffs(uint x){
+	//Index of the lowest set bit, x != 0
+#if defined(__GNUC__)
+	return __builtin_ctz(x);
+#else
+	static const unsigned char DeBruijn[32] = {
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9};
+	return DeBruijn[((x & (0U - x)) * 0x077CB531U) >> 27];
+#endif
+}
+
+static void ring_pushFront(listobj** ppHead, listobj* pObj){
+	listobj* pHead = *ppHead;
+	if(!pHead){
+		pObj->pNext = pObj->pPrevious = pObj;
+	}else{
+		pObj->pNext = pHead;
+		pObj->pPrevious = pHead->pPrevious;
+		pHead->pPrevious->pNext = pObj;
+		pHead->pPrevious = pObj;
+	}
+	*ppHead = pObj;
+}
+
+static void ring_insert(listobj** ppHead, listobj* pObj){
+	//Sorted insert searching from the tail, new item before equal ones
+	listobj* pMarker;
+	if(!*ppHead || KEY(*ppHead) >= KEY(pObj)){
+		ring_pushFront(ppHead, pObj);
+		return;
+	}
+	pMarker = (*ppHead)->pPrevious;
+	while(KEY(pMarker) >= KEY(pObj))
+		pMarker = pMarker->pPrevious;
+	pObj->pNext = pMarker->pNext;
+	pObj->pPrevious = pMarker;
+	pMarker->pNext->pPrevious = pObj;
+	pMarker->pNext = pObj;
+}
+
+static void ring_remove(listobj** ppHead, listobj* pObj){
+	if(pObj->pNext == pObj){
+		*ppHead = NULL;
+	}else{
+		pObj->pPrevious->pNext = pObj->pNext;
+		pObj->pNext->pPrevious = pObj->pPrevious;
+		if(*ppHead == pObj) *ppHead = pObj->pNext;
+	}
+	pObj->pNext = pObj->pPrevious = NULL;
+}
+
+static int rq_inWindow(readyq* q, uint d){
+	return d >= q->nBase && ((d - q->nBase) >> RQ_SHIFT) < RQ_BUCKETS;
+}
+
+static void rq_link(readyq* q, listobj* pObj){
+	uint b = (KEY(pObj) >> RQ_SHIFT) & (RQ_BUCKETS - 1);
+	pObj->nIndex = b;
+	ring_insert(&q->pBucket[b], pObj);
+	q->Bitmap[b >> 5] |= 1U << (b & 31);
+	q->nSummary |= 1U << (b >> 5);
+}
+
+static void rq_unlink(readyq* q, listobj* pObj){
+	uint b = pObj->nIndex;
+	ring_remove(&q->pBucket[b], pObj);
+	if(!q->pBucket[b]){
+		q->Bitmap[b >> 5] &= ~(1U << (b & 31));
+		if(!q->Bitmap[b >> 5]) q->nSummary &= ~(1U << (b >> 5));
+	}
+}
+
+static uint rq_firstBucket(readyq* q){
+	//First non-empty bucket in window order, nSummary != 0
+	uint b0 = (q->nBase >> RQ_SHIFT) & (RQ_BUCKETS - 1);
+	uint w = b0 >> 5;
+	uint bits = q->Bitmap[w] & (~0U << (b0 & 31));
+	if(!bits){
+		uint words = q->nSummary & ~((2U << w) - 1); //Words after w
+		if(!words) words = q->nSummary; //Wrap around
+		w = rq_ffs(words);
+		bits = q->Bitmap[w];
+	}
+	return (w << 5) + rq_ffs(bits);
+}
+
+static void rq_lowerBase(readyq* q, uint nBase){
+	//Move the window down to nBase, buckets falling off the top end
+	//are moved to the overflow list
+	uint k = (q->nBase - nBase) >> RQ_SHIFT;
+	uint b0 = (q->nBase >> RQ_SHIFT) & (RQ_BUCKETS - 1);
+	uint i;
+	if(k > RQ_BUCKETS) k = RQ_BUCKETS;
+	for(i = RQ_BUCKETS; i-- > RQ_BUCKETS - k;){
+		uint b = (b0 + i) & (RQ_BUCKETS - 1);
+		if(!q->Bitmap[b >> 5]){ //Skip the rest of an empty word
+			uint skip = b & 31;
+			if(skip > i - (RQ_BUCKETS - k)) skip = i - (RQ_BUCKETS - k);
+			i -= skip;
+			continue;
+		}
+		while(q->pBucket[b]){
+			listobj* pObj = q->pBucket[b];
+			rq_unlink(q, pObj);
+			pObj->nIndex = RQ_OVERFLOW;
+			ring_pushFront(&q->pOverflow, pObj);
+		}
+	}
+	q->nBase = nBase;
+}
+
+static void rq_refill(readyq* q, uint nBase){
+	//Window empty: start it at the earliest of nBase and the overflow
+	//list and pull in the overflow items that now fit
+	listobj* pObj = q->pOverflow;
+	listobj* pNext;
+	uint n = 0;
+	if(pObj){
+		do{
+			if(KEY(pObj) < nBase) nBase = KEY(pObj);
+			pObj = pObj->pNext;
+			n++;
+		}while(pObj != q->pOverflow);
+	}
+	q->nBase = nBase & ~RQ_MASK;
+	for(; n; n--, pObj = pNext){
+		pNext = pObj->pNext;
+		if(rq_inWindow(q, KEY(pObj))){
+			ring_remove(&q->pOverflow, pObj);
+			rq_link(q, pObj);
+		}
+	}
+}
+
+void rq_insertObj(readyq* q, listobj* pObj){
+	uint d = KEY(pObj);
+	if(!q->nSummary){ //Window empty, move it
+		rq_refill(q, d);
+	}else if(d < q->nBase){
+		rq_lowerBase(q, d & ~RQ_MASK);
+	}
+	if(rq_inWindow(q, d)){
+		rq_link(q, pObj);
+	}else{
+		pObj->nIndex = RQ_OVERFLOW;
+		ring_pushFront(&q->pOverflow, pObj);
+	}
+	q->nCount++;
+}
+
+void rq_extractObj(readyq* q, listobj* pObj){
+	if(pObj->nIndex == RQ_OVERFLOW)
+		ring_remove(&q->pOverflow, pObj);
+	else
+		rq_unlink(q, pObj);
+	q->nCount--;
+}
+
+listobj* rq_first(readyq* q){
+	if(!q->nSummary){
+		if(!q->pOverflow) return NULL;
+		rq_refill(q, ~0U);
+	}
+	return q->pBucket[rq_firstBucket(q)];
+}
+
+void rq_insertChain(readyq* q, listobj* pFirst){
+	//No batch shortcut, each insert places itself in the window
+	while(pFirst){
+		listobj* pNext = pFirst->pNext;
+		rq_insertObj(q, pFirst);
+		pFirst = pNext;
+	}
+}
+
+#else
+
+void rq_insertObj(readyq* q, listobj* pObj){
+	listobj* pMarker = &q->Head;
+	while(pMarker->pNext != &q->Tail && KEY(pMarker->pNext) < KEY(pObj))
+		pMarker = pMarker->pNext;
+	pObj->pNext = pMarker->pNext;
+	pObj->pPrevious = pMarker;
+	pMarker->pNext = pObj;
+	pObj->pNext->pPrevious = pObj;
+	q->nCount++;
+}
+
+void rq_extractObj(readyq* q, listobj* pObj){
+	pObj->pPrevious->pNext = pObj->pNext;
+	pObj->pNext->pPrevious = pObj->pPrevious;
+	pObj->pNext = pObj->pPrevious = NULL;
+	q->nCount--;
+}
+
+listobj* rq_first(readyq* q){
+	return q->Head.pNext != &q->Tail ? q->Head.pNext : NULL;
+}
+
+void rq_insertChain(readyq* q, listobj* pFirst){
+	//Item by item, a batch mostly lands near the head of the list
+	while(pFirst){
+		listobj* pNext = pFirst->pNext;
+		rq_insertObj(q, pFirst);
+		pFirst = pNext;
+	}
+}
+
+#endif
+
+readyq* create_readyq(uint nCapacity){
+	readyq* q = (readyq*)calloc(1, sizeof(readyq));
+	if(!q) return NULL;
+#if READYQ == READYQ_HEAP
+	q->pHeap = (listobj**)calloc(nCapacity, sizeof(listobj*));
+	if(!q->pHeap){
+		free(q);
+		return NULL;
+	}
+	q->nCapacity = nCapacity;
+#elif READYQ == READYQ_LIST
+	q->Head.pNext = &q->Tail;
+	q->Head.pPrevious = &q->Head;
+	q->Tail.pNext = &q->Tail;
+	q->Tail.pPrevious = &q->Head;
+#endif
+	(void)nCapacity;
+	return q;
+}
+
+void deleteReadyq(readyq* q){
+#if READYQ == READYQ_HEAP
+	free(q->pHeap);
+#endif
+	free(q);
+}
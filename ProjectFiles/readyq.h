@@ -0,0 +1,39 @@
+#ifndef READYQ_H
+#define READYQ_H
+
+#include "kernel.h"
+
+/*********************************************************/
+/** Deadline queue used for the Readylist and Waitinglist */
+/*********************************************************/
+
+#define RQ_WORDS        32                      // Bitmap words, power of 2, <= 32
+#define RQ_BUCKETS      (RQ_WORDS * 32)         // Number of deadline buckets
+#define RQ_SHIFT        4                       // log2 of ticks per bucket
+#define RQ_OVERFLOW     RQ_BUCKETS              // nIndex of items outside the window
+
+typedef struct rq {
+        uint            nCount;
+#if READYQ == READYQ_HEAP
+        listobj         **pHeap;                // Min-heap on DeadLine
+        uint            nCapacity;
+#elif READYQ == READYQ_BITMAP
+        uint            nBase;                  // First tick of the bucket window
+        uint            nSummary;               // Bit w set if Bitmap[w] != 0
+        uint            Bitmap[RQ_WORDS];       // Bit b set if pBucket[b] != NULL
+        listobj         *pBucket[RQ_BUCKETS];   // Circular sorted lists
+        listobj         *pOverflow;             // Deadlines beyond the window
+#else
+        listobj         Head;
+        listobj         Tail;
+#endif
+} readyq;
+
+readyq*         create_readyq( uint nCapacity );
+void            rq_insertObj( readyq* q, listobj* pObj );
+void            rq_extractObj( readyq* q, listobj* pObj );
+void            rq_insertChain( readyq* q, listobj* pFirst );
+listobj*        rq_first( readyq* q );
+void            deleteReadyq( readyq* q );
+
+#endif
@@ -0,0 +1,88 @@
+/* test_admit.c
+ * EDF admission control of create_periodic_task() on the host:
+ *   gcc -o test_admit test_admit.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c host_stubs.c utest.c
+ * With every deadline at the end of its period a task is admitted as
+ * long as the utilisation stays at most 1. With earlier deadlines the
+ * demand at each deadline decides, also when the utilisation is low.
+ * A terminated task gives its share back, and a rejected task must
+ * not be created. Shares that only fit when rounded down must be
+ * rejected, and so must a set that takes too long to check.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+extern TCB* Tasks[MAX_TASKS];
+
+void body(void){}
+
+uint tasks(void){
+	uint i, n = 0;
+	for(i = 0; i < MAX_TASKS; i++)
+		if(Tasks[i]) n++;
+	return n;
+}
+
+void check_implicit(void){
+	assert(init_kernel() == OK);
+	set_ticks(10);
+	assert(create_periodic_task(body, 1, 3, 3) == OK);
+	assert(isEqualInt(Tasks[1]->DeadLine, 13)); // First deadline, one period from now
+	assert(create_periodic_task(body, 1, 3, 3) == OK);
+	assert(create_periodic_task(body, 1, 3, 3) == OK); // Utilisation 1
+	assert(create_periodic_task(body, 1, 1000, 1000) == NOT_SCHEDULABLE);
+	assert(isEqualInt(tasks(), 4));
+	assert(create_task(body, 5) == OK); // Not part of the test
+	run();
+	terminate(); // The create_task one
+	terminate(); // A periodic one, a third of the CPU is free again
+	assert(create_periodic_task(body, 1, 6, 6) == OK);
+	assert(create_periodic_task(body, 1, 6, 6) == OK);
+	assert(create_periodic_task(body, 1, 6, 6) == NOT_SCHEDULABLE);
+}
+
+void check_constrained(void){
+	assert(init_kernel() == OK);
+	assert(create_periodic_task(body, 2, 10, 4) == OK);
+	assert(create_periodic_task(body, 2, 10, 4) == OK);
+	assert(create_periodic_task(body, 1, 10, 4) == NOT_SCHEDULABLE); // 5 ticks by 4
+	assert(create_periodic_task(body, 1, 10, 5) == OK);
+	assert(create_periodic_task(body, 1, 5, 5) == NOT_SCHEDULABLE); // 6 by 5
+	assert(create_periodic_task(body, 1, 20, 10) == OK);
+	assert(create_periodic_task(body, 5, 40, 12) == NOT_SCHEDULABLE); // 15 by 14, utilisation 0.675
+	assert(create_periodic_task(body, 3, 40, 40) == OK);
+	assert(isEqualInt(tasks(), 6));
+	assert(create_periodic_task(body, 0, 10, 10) == FAIL);
+	assert(create_periodic_task(body, 5, 10, 4) == FAIL); // Longer than its deadline
+	assert(create_periodic_task(body, 1, 10, 11) == FAIL); // Deadline after the period
+}
+
+void check_rounding(void){
+	// Each share rounded down sums to under 1, the real sum is over
+	assert(init_kernel() == OK);
+	assert(create_periodic_task(body, 65536, 65537, 65537) == OK);
+	assert(create_periodic_task(body, 1, 65536, 65536) == NOT_SCHEDULABLE);
+	assert(create_periodic_task(body, 1, 65537, 65537) == OK); // Exactly 1
+	assert(isEqualInt(tasks(), 3));
+}
+
+void check_steps(void){
+	// Schedulable, utilisation 0.9998, but QPA takes about 1500
+	// passes over Tasks[] to show it, too many with interrupts off
+	assert(init_kernel() == OK);
+	assert(create_periodic_task(body, 2064, 12390, 8956) == OK);
+	assert(create_periodic_task(body, 763, 4580, 4355) == OK);
+	assert(create_periodic_task(body, 2690, 16147, 13968) == OK);
+	assert(create_periodic_task(body, 1408, 8450, 7842) == OK);
+	assert(create_periodic_task(body, 1426, 8562, 7089) == OK);
+	assert(create_periodic_task(body, 3158, 18951, 18678) == NOT_SCHEDULABLE);
+	assert(isEqualInt(tasks(), 6));
+}
+
+int main(void)
+{
+	check_implicit();
+	check_constrained();
+	check_rounding();
+	check_steps();
+	return 0;
+}
@@ -0,0 +1,132 @@
+/* test_channel.c
+ * Interrupt to task channels on the host:
+ *   gcc -o test_channel test_channel.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c host_stubs.c utest.c
+ * Items must come out in order, a full ring must drop and count the
+ * new item, and sending must not allocate. A send to a blocked
+ * consumer must only mark it, the consumer becomes ready at
+ * isr_exit(), or at the next tick if the handler does not call it.
+ * A consumer whose deadline passes must be released still waiting.
+ * Built with SOFTIRQ, as host/test_softirq_channel is, a handler taken
+ * while the tick walks the lists must leave Running and the lists to
+ * the tick, which then wakes the consumer.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+extern TCB* Running;
+
+void TimerInt(void);
+
+void body(void){}
+
+#ifdef SOFTIRQ
+channel* pFire; // Send on it from the next isr_on() in the tick's walk
+
+void isr_on(void){
+	if(pFire && isr_nested()){ // A channel interrupt taken in the walk
+		channel* ch = pFire;
+		TCB* pBefore = Running;
+		uint i = 7;
+		pFire = NULL;
+		assert(channel_send_isr(ch, &i) == OK);
+		isr_exit();
+		assert(Running == pBefore);
+		assert(ch->bWake);
+	}
+}
+#endif
+
+int main(void)
+{
+	channel* ch;
+	TCB* pC;
+	TCB* pB;
+	uint i, x, nLost;
+	heapstat h0, h1;
+	poolstat p;
+
+	assert(init_kernel() == OK);
+	assert(create_task(body, 100) == OK); // Consumer
+	assert(create_task(body, 200) == OK);
+	assert(create_channel(0, sizeof(uint)) == NULL);
+	assert((ch = create_channel(3, sizeof(uint))) != NULL);
+	assert(isEqualInt(ch->nMask, 3));
+	run();
+	pC = Running;
+
+	// Order, overflow
+	for(i = 1; i <= 4; i++)
+		assert(channel_send_isr(ch, &i) == OK);
+	assert(channel_send_isr(ch, &i) == FAIL);
+	assert(isEqualInt(ch->nLost, 1));
+	for(i = 1; i <= 4; i++){
+		assert(channel_receive_no_wait(ch, &x) == OK);
+		assert(isEqualInt(x, i));
+	}
+	assert(channel_receive_no_wait(ch, &x) == FAIL);
+	channel_receive_wait(ch, &x); // Blocks, returns here as the next task
+	pB = Running;
+	assert(pB != pC);
+	assert(ch->pWaiter == pC);
+
+	// Woken at isr_exit(), not by the send
+	i = 42;
+	assert(channel_send_isr(ch, &i) == OK);
+	assert(Running == pB);
+	assert(ch->bWake);
+	isr_exit();
+	assert(Running == pC);
+	assert(ch->pWaiter == NULL && !ch->bWake);
+	assert(channel_receive_no_wait(ch, &x) == OK);
+	assert(isEqualInt(x, 42));
+
+	// Woken at the tick
+	channel_receive_wait(ch, &x);
+	assert(Running == pB);
+	assert(channel_send_isr(ch, &i) == OK);
+	TimerInt();
+	assert(Running == pC);
+	assert(channel_receive_no_wait(ch, &x) == OK);
+#ifdef SOFTIRQ
+	// Sent during the walk, woken by the tick's tail
+	channel_receive_wait(ch, &x);
+	assert(Running == pB);
+	pFire = ch;
+	TimerInt();
+	assert(pFire == NULL);
+	assert(Running == pC);
+	assert(channel_receive_no_wait(ch, &x) == OK);
+	assert(isEqualInt(x, 7));
+#endif
+
+	// A burst the consumer keeps up with, no allocation
+	heap_stats(&h0);
+	nLost = ch->nLost;
+	for(i = 0; i < 10000; i++){
+		assert(channel_send_isr(ch, &i) == OK);
+		if(i % 4 == 3){
+			uint j;
+			for(j = i - 3; j <= i; j++){
+				assert(channel_receive_no_wait(ch, &x) == OK);
+				assert(isEqualInt(x, j));
+			}
+		}
+	}
+	heap_stats(&h1);
+	assert(isEqualInt(h1.nUsed, h0.nUsed));
+	assert(isEqualInt(ch->nLost, nLost));
+
+	// Deadline
+	channel_receive_wait(ch, &x);
+	assert(Running == pB);
+	assert(remove_channel(ch) == FAIL);
+	while(Running != pC)
+		TimerInt();
+	assert(isEqualInt(ticks(), 100));
+	assert(ch->pWaiter == pC); // Not woken by the handler
+	ch->pWaiter = NULL; // As the consumer does when it runs
+	assert(remove_channel(ch) == OK);
+	assert(pool_stats(POOL_CHANNEL, &p) == OK);
+	assert(isEqualInt(p.nUsed, 0));
+	return 0;
+}
@@ -0,0 +1,132 @@
+/* test_gedf.c
+ * Global EDF on host threads, see gedf.c:
+ *   gcc -pthread -o test_gedf test_gedf.c gedf.c readyq.c utest.c
+ * On one core tasks must run in deadline order and a task created
+ * with an earlier deadline must preempt its creator at once. On two
+ * cores a new earliest task must preempt the core running the latest
+ * deadline, not the other one, at its next gedf_poll(), and the
+ * preempted task must still finish. Two earlier tasks created one
+ * after the other must ask both cores, not wait for the first request
+ * to be answered. Many tasks on four cores must all run to the end.
+ */
+#include "gedf.h"
+#include "utest.h"
+
+volatile uint Log[16];
+volatile uint nLog;
+volatile uint bA, bB, bE;
+volatile uint bC, bD, bY, bCDone;
+uint Running[GEDF_MAX_CORES];
+volatile uint nDone;
+
+void logged(void* pArg){
+	Log[nLog++] = (uint)(unsigned long)pArg;
+}
+
+void parent(void* pArg){
+	Log[nLog++] = (uint)(unsigned long)pArg;
+	assert(gedf_create(logged, (void*)5, 5) == OK); // Runs before this returns
+	assert(isEqualInt(Log[nLog - 1], 5));
+}
+
+void early(void* pArg){ // Deadline 50
+	gedf_running(Running);
+	bE = TRUE;
+}
+
+void a(void* pArg){ // Deadline 200
+	bA = TRUE;
+	while(!bB);
+	assert(gedf_create(early, NULL, 50) == OK);
+	while(!bE);
+}
+
+void b(void* pArg){ // Deadline 300, polls until preempted and resumed
+	bB = TRUE;
+	while(!bE)
+		gedf_poll();
+}
+
+void x(void* pArg){ // Deadline 10, keeps its core until y runs
+	while(!bY)
+		gedf_poll();
+}
+
+void y(void* pArg){ // Deadline 20
+	bY = TRUE;
+}
+
+void c(void* pArg){ // Deadline 100
+	bC = TRUE;
+	while(!bD);
+	assert(gedf_create(x, NULL, 10) == OK); // Asks d's core
+	assert(gedf_create(y, NULL, 20) == OK); // Asks this one, y runs first
+	assert(bY);
+	bCDone = TRUE;
+}
+
+void d(void* pArg){ // Deadline 200, polls until c is done
+	bD = TRUE;
+	while(!bCDone)
+		gedf_poll();
+}
+
+void work(void* pArg){
+	volatile uint i;
+	for(i = 0; i < 100000; i++);
+	__atomic_add_fetch(&nDone, 1, __ATOMIC_RELAXED);
+}
+
+int main(void)
+{
+	gedfstat s;
+	uint i;
+
+	// One core: deadline order, preempted by a child
+	assert(gedf_init(1) == OK);
+	assert(gedf_create(logged, (void*)40, 40) == OK);
+	assert(gedf_create(logged, (void*)10, 10) == OK);
+	assert(gedf_create(parent, (void*)30, 30) == OK);
+	assert(gedf_create(logged, (void*)20, 20) == OK);
+	gedf_run();
+	assert(isEqualInt(nLog, 5));
+	assert(isEqualInt(Log[0], 10));
+	assert(isEqualInt(Log[1], 20));
+	assert(isEqualInt(Log[2], 30));
+	assert(isEqualInt(Log[3], 5));
+	assert(isEqualInt(Log[4], 40));
+	gedf_stats(&s);
+	assert(isEqualInt(s.nRequests, 1));
+	assert(isEqualInt(s.nPreemptions, 1));
+	assert(isEqualInt(s.nDispatches, 6));
+
+	// Two cores: the latest deadline gives way
+	assert(gedf_init(2) == OK);
+	assert(gedf_create(a, NULL, 200) == OK);
+	assert(gedf_create(b, NULL, 300) == OK);
+	gedf_run();
+	assert((Running[0] == 50 && Running[1] == 200) || (Running[0] == 200 && Running[1] == 50));
+	gedf_stats(&s);
+	assert(isEqualInt(s.nRequests, 1));
+	assert(isEqualInt(s.nPreemptions, 1));
+	assert(isEqualInt(s.nDispatches, 4));
+
+	// Two cores, two requests outstanding
+	assert(gedf_init(2) == OK);
+	assert(gedf_create(c, NULL, 100) == OK);
+	assert(gedf_create(d, NULL, 200) == OK);
+	gedf_run();
+	gedf_stats(&s);
+	assert(isEqualInt(s.nRequests, 2));
+	assert(isEqualInt(s.nPreemptions, 2));
+
+	// Four cores, more tasks than cores
+	assert(gedf_init(4) == OK);
+	for(i = 0; i < 64; i++)
+		assert(gedf_create(work, NULL, 1000 + (i * 37) % 64) == OK);
+	gedf_run();
+	assert(isEqualInt(nDone, 64));
+	gedf_stats(&s);
+	assert(s.nDispatches >= 64);
+	return 0;
+}
@@ -0,0 +1,86 @@
+/* test_host.c
+ * The kernel on the Linux host port, real context switches and a
+ * SIGALRM tick, see kernel_host.c:
+ *   make host/test_host
+ * host/test_softirq is the same test with SOFTIRQ.
+ * A busy task with a later deadline must be preempted when an earlier
+ * one leaves the Timerlist, Messages must pass between running tasks,
+ * a timed receive must end at its limit, a blocked receive must end
+ * at its deadline and count a miss, a semaphore must pass a signal
+ * between tasks, and returning from a task body must terminate it. A
+ * periodic task must be released on its period boundaries. The process exits once only
+ * the idle task is left.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+#define SPINS   1000
+
+mailbox* mb;
+mailbox* mbEmpty;
+semaphore* sem;
+volatile uint nSpins;
+volatile uint bDone;
+
+void early(void){ // Deadline 100
+	uint i, nStart = ticks();
+	int x = 0;
+	for(i = 0; i < 5; i++)
+		assert(wait(2) == OK);
+	assert(ticks() >= nStart + 10);
+	assert(nSpins > SPINS); // late was preempted, it never blocks
+	assert(receive_wait(mb, &x) == OK);
+	assert(isEqualInt(x, 42));
+	assert(wait_semaphore(sem) == OK); // Signalled by late
+	bDone = TRUE;
+}
+
+void late(void){ // Deadline 200, never blocks
+	int x = 42;
+	while(!bDone){
+		if(++nSpins == SPINS)
+			assert(send_no_wait(mb, &x) == OK);
+		if(nSpins == 2 * SPINS)
+			signal_semaphore(sem);
+	}
+}
+
+void last(void){ // Deadline 300, runs once the others are done
+	int x;
+	assert(bDone);
+	taskstat s;
+	uint nStart = ticks();
+	assert(receive_wait_timeout(mbEmpty, &x, 5) == TIMEOUT);
+	assert(ticks() - nStart >= 5 && ticks() < 300);
+	assert(receive_wait(mbEmpty, &x) == DEADLINE_REACHED);
+	assert(ticks() >= 300);
+	assert(task_stats(task_id(), &s) == OK);
+	assert(isEqualInt(s.nMisses, 1));
+	assert(s.nWaiting > 0 && s.nWaiting <= 300);
+}
+
+void periodic(void){ // Period 20 from tick 0, deadline at its end
+	uint i;
+	taskstat s;
+	for(i = 1; i <= 3; i++){
+		assert(wait_next_period() == OK);
+		assert(ticks() - 20 * i < 2); // Deadline before the others, runs at once
+		assert(isEqualInt(deadline(), 20 * i + 20));
+	}
+	assert(task_stats(task_id(), &s) == OK);
+	assert(isEqualInt(s.nReleases, 3));
+}
+
+int main(void)
+{
+	assert(init_kernel() == OK);
+	assert(create_task(early, 100) == OK);
+	assert(create_task(late, 200) == OK);
+	assert(create_task(last, 300) == OK);
+	assert(create_periodic_task(periodic, 1, 20, 20) == OK);
+	assert((mb = create_mailbox(1, sizeof(int))) != NULL);
+	assert((mbEmpty = create_mailbox(1, sizeof(int))) != NULL);
+	assert((sem = create_semaphore(0)) != NULL);
+	run();
+	return 1; // Not reached
+}
@@ -0,0 +1,113 @@
+/* test_isrstat.c
+ * Interrupts-off windows on the host:
+ *   gcc -DISR_STATS -o test_isrstat test_isrstat.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c isrstat.c host_stubs.c utest.c
+ * Each kernel call that disables interrupts must count one window for
+ * itself, also when a helper or another public call does the work,
+ * TimerInt() one from its entry, nested isr_off() calls must
+ * stay in the window of the first, and window times must land in
+ * their log2 bucket and in the mean and worst.
+ */
+#include "kernel.h"
+#include "isrstat.h"
+#include "utest.h"
+#include <string.h>
+
+void TimerInt(void);
+
+uint nClock;
+uint timer0_stamp(uint nTicks){ return nClock; }
+
+void body(void){}
+
+isrsite Sites[ISR_SITES];
+uint nSites;
+
+isrsite* find(const char* pName){
+	uint i;
+	for(i = 0; i < nSites; i++)
+		if(!strcmp(Sites[i].pName, pName)) return &Sites[i];
+	return NULL;
+}
+
+int main(void)
+{
+	static const char Outer[] = "outer", Inner[] = "inner";
+	mailbox* mb;
+	mailbox* mw;
+	isrsite* pSite;
+	uint x = 0;
+	assert(init_kernel() == OK);
+	assert(create_task(body, 100) == OK);
+	run();
+
+	// Kernel calls, one window each under their own name
+	isr_stats_reset();
+	assert(isEqualInt(isr_stats(Sites, ISR_SITES), 0));
+	assert((mb = create_mailbox(4, sizeof(uint))) != NULL);
+	assert(send_no_wait(mb, &x) == OK);
+	assert(send_no_wait(mb, &x) == OK);
+	TimerInt();
+	nSites = isr_stats(Sites, ISR_SITES);
+	assert((pSite = find("send_no_wait")) != NULL);
+	assert(isEqualInt(pSite->nCount, 2));
+	assert(isEqualInt(pSite->Hist[0], 2)); // The clock stood still
+	assert((pSite = find("TimerInt")) != NULL);
+	assert(isEqualInt(pSite->nCount, 1));
+
+	// Charged to the call made, not to the helpers that serve it
+	assert((mw = create_mailbox(1, sizeof(uint))) != NULL);
+	isr_stats_reset();
+	assert(create_task(body, 200) == OK);
+	assert(create_ring_mailbox(4, sizeof(uint)) != NULL);
+	assert(receive_wait(mw, &x) == OK); // Blocks, returns as task 2
+	assert(isEqualInt(task_id(), 2));
+	assert(send_wait(mw, &x) == OK); // Hands it over, back to task 1
+	assert(isEqualInt(task_id(), 1));
+	nSites = isr_stats(Sites, ISR_SITES);
+	assert((pSite = find("create_task")) != NULL);
+	assert(isEqualInt(pSite->nCount, 2)); // Stack, then the Readylist
+	assert((pSite = find("create_ring_mailbox")) != NULL);
+	assert(isEqualInt(pSite->nCount, 2)); // Mailbox, then the ring
+	assert((pSite = find("receive_wait")) != NULL);
+	assert(isEqualInt(pSite->nCount, 2)); // Block, then end of wait
+	assert((pSite = find("send_wait")) != NULL);
+	assert(isEqualInt(pSite->nCount, 2));
+	assert(find("create_task_stack") == NULL);
+	assert(find("start_task") == NULL);
+	assert(find("create_mailbox") == NULL);
+	assert(find("end_msg_wait") == NULL);
+	assert(find("receive_wait_timeout") == NULL);
+
+	// Times and buckets, a nested isr_off() is not a window
+	isr_stats_reset();
+	isr_stat_off(Outer);
+	nClock += 5;
+	isr_stat_off(Inner);
+	nClock += 1;
+	isr_stat_on(); // 6: bucket 3, 4 to 7
+	isr_stat_on(); // Already on
+	isr_stat_off(Outer);
+	nClock += 1;
+	isr_stat_on(); // 1: bucket 1
+	isr_stat_begin(Outer);
+	nClock += 1000;
+	isr_stat_end(); // 1000: bucket 10, 512 to 1023
+	assert(isEqualInt(isr_stats(Sites, ISR_SITES), 1));
+	assert(Sites[0].pName == Outer);
+	assert(isEqualInt(Sites[0].nCount, 3));
+	assert(isEqualInt(Sites[0].nMax, 1000));
+	assert(isEqualInt((uint)Sites[0].nTotal, 1007));
+	assert(isEqualInt(Sites[0].Hist[3], 1));
+	assert(isEqualInt(Sites[0].Hist[1], 1));
+	assert(isEqualInt(Sites[0].Hist[10], 1));
+	assert(isEqualInt(Sites[0].Hist[0], 0));
+
+	// Only the first nMax sites are copied
+	isr_stat_off(Inner);
+	isr_stat_on();
+	assert(isEqualInt(isr_stats(Sites, 1), 1));
+	assert(Sites[0].pName == Outer);
+	assert(isEqualInt(isr_stats(Sites, ISR_SITES), 2));
+	assert(Sites[1].pName == Inner);
+	return 0;
+}
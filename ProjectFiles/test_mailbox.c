@@ -0,0 +1,199 @@
+/* test_mailbox.c
+ * Linked and ring mailboxes on the host:
+ *   gcc -o test_mailbox test_mailbox.c kernel.c readyq.c twheel.c pool.c tlsf.c host_stubs.c utest.c
+ * Both kinds must give the same FIFO order, overwrite the oldest
+ * Message when full, keep nMessages/nBlockedMsg and hand a Message
+ * straight to a blocked receiver. The ring must not allocate per
+ * Message. Buffer mailboxes pass the buffer itself and release the
+ * buffers they drop. The batch calls must move the same Messages in
+ * the same order as one call per Message and report how many moved.
+ * A call that leaves the calling task first must not switch context.
+ * A mailbox full of blocked tasks must refuse a new Message rather
+ * than drop one a blocked task still owns.
+ */
+#include "kernel.h"
+#include "utest.h"
+#include <limits.h>
+
+extern TCB* Running;
+
+void RunningContext(void);
+
+uint nSwitches;
+void SwitchContext(void){ nSwitches++; RunningContext(); }
+
+void body(void){}
+
+void check(mailbox* mb){
+	int i, x = 0;
+	heapstat h0, h1;
+	poolstat p0, p1;
+	heap_stats(&h0);
+	pool_stats(POOL_MSG, &p0);
+	for(i = 1; i <= 5; i++)
+		assert(send_no_wait(mb, &i) == OK);
+	assert(isEqualInt(mb->nMessages, 3));
+	assert(isEqualInt(mb->nBlockedMsg, 0));
+	heap_stats(&h1);
+	pool_stats(POOL_MSG, &p1);
+	if(mb->pRing){
+		assert(isEqualInt(h1.nUsed, h0.nUsed));
+		assert(isEqualInt(p1.nUsed, p0.nUsed));
+	}
+	for(i = 3; i <= 5; i++){ // Oldest two were overwritten
+		assert(receive_no_wait(mb, &x) == OK);
+		assert(isEqualInt(x, i));
+	}
+	assert(receive_no_wait(mb, &x) == FAIL);
+	assert(isEqualInt(mb->nMessages, 0));
+	heap_stats(&h1);
+	assert(isEqualInt(h1.nUsed, h0.nUsed));
+
+	i = 7; // Buffered, then taken by receive_wait
+	assert(send_no_wait(mb, &i) == OK);
+	assert(receive_wait(mb, &x) == OK);
+	assert(isEqualInt(x, 7));
+
+	{ // Receiver blocks, sender hands over directly
+		TCB* pReceiver = Running;
+		x = 0;
+		receive_wait(mb, &x);
+		assert(Running != pReceiver);
+		assert(isEqualInt(mb->nBlockedMsg, -1));
+		i = 9;
+		assert(send_no_wait(mb, &i) == OK);
+		assert(isEqualInt(x, 9));
+		assert(isEqualInt(mb->nBlockedMsg, 0));
+		assert(isEqualInt(mb->nMessages, 0));
+		assert(isEqualPointer(Running, pReceiver));
+	}
+	assert(no_messages(mb) == OK);
+	heap_stats(&h1);
+	assert(h1.nUsed <= h0.nUsed);
+}
+
+void check_buffers(void){
+	heapstat h0, h1;
+	char* p[4];
+	void* pGot;
+	int i;
+	mailbox* mb = create_buffer_mailbox(2);
+	assert(mb != NULL);
+	heap_stats(&h0);
+	for(i = 0; i < 4; i++){
+		p[i] = (char*)create_buffer(100);
+		assert(p[i] != NULL);
+		p[i][99] = (char)i;
+		assert(send_buffer(mb, p[i]) == OK);
+	}
+	assert(isEqualInt(mb->nMessages, 2));
+	for(i = 2; i < 4; i++){ // p[0] and p[1] were released when dropped
+		assert(receive_buffer(mb, &pGot) == OK);
+		assert(isEqualPointer(pGot, p[i]));
+		assert(isEqualInt(((char*)pGot)[99], i));
+		release_buffer(pGot);
+	}
+	heap_stats(&h1);
+	assert(isEqualInt(h1.nUsed, h0.nUsed));
+
+	{ // Receiver blocks, the buffer is handed over directly
+		TCB* pReceiver = Running;
+		receive_buffer(mb, &pGot);
+		assert(Running != pReceiver);
+		p[0] = (char*)create_buffer(10);
+		assert(send_buffer(mb, p[0]) == OK);
+		assert(isEqualPointer(pGot, p[0]));
+		assert(isEqualPointer(Running, pReceiver));
+		release_buffer(pGot);
+	}
+	assert(send_buffer(create_mailbox(1, 4), p[0]) == FAIL);
+	assert(no_messages(mb) == OK);
+}
+
+void check_batch(mailbox* mb){
+	int in[6] = {1, 2, 3, 4, 5, 6}, out[6] = {0};
+	heapstat h0, h1;
+	heap_stats(&h0);
+	assert(isEqualInt(send_no_wait_n(mb, in, 2), 2));
+	assert(isEqualInt(send_no_wait_n(mb, in + 2, 4), 4));
+	assert(isEqualInt(mb->nMessages, 4)); // 1 and 2 were overwritten
+	assert(isEqualInt(receive_no_wait_n(mb, out, 6), 4));
+	assert(isEqualInt(out[0], 3));
+	assert(isEqualInt(out[3], 6));
+	assert(isEqualInt(receive_no_wait_n(mb, out, 6), 0));
+	heap_stats(&h1);
+	assert(isEqualInt(h1.nUsed, h0.nUsed));
+
+	{ // First item goes to the blocked receiver, the rest is buffered
+		TCB* pReceiver = Running;
+		int x = 0;
+		receive_wait(mb, &x);
+		assert(Running != pReceiver);
+		assert(isEqualInt(send_no_wait_n(mb, in, 3), 3));
+		assert(isEqualInt(x, 1));
+		assert(isEqualPointer(Running, pReceiver));
+		assert(isEqualInt(receive_no_wait_n(mb, out, 6), 2));
+		assert(isEqualInt(out[0], 2));
+		assert(isEqualInt(out[1], 3));
+	}
+}
+
+void check_full(void){
+	mailbox* mb = create_mailbox(1, sizeof(int));
+	TCB* pFirst = Running;
+	int x = 0, y = 0, i = 5;
+	receive_wait(mb, &x); // Fills the mailbox
+	assert(Running != pFirst);
+	assert(receive_wait(mb, &y) == FAIL);
+	assert(isEqualInt(mb->nMessages, 1));
+	assert(isEqualInt(mb->nBlockedMsg, -1));
+	assert(isEqualPointer(Running->Node.pMessage, NULL));
+	assert(send_no_wait(mb, &i) == OK); // The blocked receiver gets it
+	assert(isEqualInt(x, 5));
+	assert(isEqualPointer(Running, pFirst));
+
+	send_wait(mb, &i); // Now full of a blocked sender
+	assert(Running != pFirst);
+	i = 6;
+	assert(send_wait(mb, &i) == FAIL);
+	assert(send_no_wait(mb, &i) == FAIL);
+	assert(isEqualInt(mb->nBlockedMsg, 1));
+	assert(receive_no_wait(mb, &y) == OK);
+	assert(isEqualInt(y, 5));
+	assert(isEqualPointer(Running, pFirst));
+	assert(no_messages(mb) == OK);
+}
+
+void check_fastpath(void){
+	mailbox* mb = create_mailbox(2, sizeof(int));
+	TCB* pCaller = Running;
+	uint nDeadline = deadline();
+	uint n = nSwitches;
+	int x = 1;
+	assert(receive_no_wait(mb, &x) == FAIL);
+	assert(send_no_wait(mb, &x) == OK);
+	assert(receive_no_wait(mb, &x) == OK);
+	set_deadline(nDeadline - 1);
+	assert(isEqualInt(nSwitches, n));
+	assert(isEqualPointer(Running, pCaller));
+	set_deadline(UINT_MAX - 1); // Behind the other task, switch
+	assert(isEqualInt(nSwitches, n + 1));
+	assert(Running != pCaller);
+}
+
+int main(void)
+{
+	assert(init_kernel() == OK);
+	assert(create_task(body, 100) == OK);
+	assert(create_task(body, 200) == OK);
+	run();
+	check(create_mailbox(3, sizeof(int)));
+	check(create_ring_mailbox(3, sizeof(int)));
+	assert(create_ring_mailbox(0, sizeof(int)) == NULL);
+	check_buffers();
+	check_batch(create_mailbox(4, sizeof(int)));
+	check_batch(create_ring_mailbox(4, sizeof(int)));
+	check_full();
+	check_fastpath();
+	return 0;
+}
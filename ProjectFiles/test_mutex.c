@@ -0,0 +1,88 @@
+/* test_mutex.c
+ * Stack Resource Policy mutexes on the host:
+ *   gcc -o test_mutex test_mutex.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c host_stubs.c utest.c
+ * Locking must never block or switch task. While a task with a long
+ * relative deadline holds a mutex, tasks that lock it, and any task
+ * whose relative deadline is not shorter than its ceiling, must not
+ * start, while a task with a shorter one preempts as usual. When the
+ * mutex is unlocked the earliest deadline task starts at once. So a
+ * task is blocked by one critical section only: the medium task that
+ * arrives meanwhile does not run before the high one (no chained
+ * blocking) and the high one never finds the mutex locked.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+void RunningContext(void);
+
+uint nSwitches;
+void SwitchContext(void){ nSwitches++; RunningContext(); }
+
+void body(void){}
+
+int main(void)
+{
+	mutex* m;
+	mutex* m2;
+	uint nLow, nHigh, nMedium, nOther, n;
+	poolstat s;
+
+	assert(init_kernel() == OK);
+	assert(create_task(body, 100) == OK); // Low, relative deadline 100
+	nLow = 1;
+	assert((m = create_mutex(10)) != NULL); // Locked by low and high
+	assert((m2 = create_mutex(100)) != NULL); // Locked by low only
+	run();
+	assert(isEqualInt(task_id(), nLow));
+
+	// Low locks without a switch and is not preempted by tasks at or
+	// below the ceiling
+	n = nSwitches;
+	assert(lock_mutex(m) == OK);
+	assert(lock_mutex(m2) == OK); // Nested
+	assert(isEqualInt(nSwitches, n));
+	assert(create_task(body, 10) == OK); // High, relative deadline 10
+	nHigh = 2;
+	assert(create_task(body, 50) == OK); // Medium, relative deadline 50
+	nMedium = 3;
+	assert(isEqualInt(nSwitches, n));
+	assert(isEqualInt(task_id(), nLow));
+
+	// A task above the ceiling preempts, low resumes when it is done
+	assert(create_task(body, 5) == OK);
+	nOther = 4;
+	assert(isEqualInt(task_id(), nOther));
+	terminate();
+	assert(isEqualInt(task_id(), nLow));
+
+	// Unlocked in the wrong order or by another task
+	assert(unlock_mutex(m) == FAIL);
+	assert(lock_mutex(m) == FAIL); // A ceiling too long for its users
+	n = nSwitches;
+	assert(unlock_mutex(m2) == OK); // Ceiling back to 10, still held
+	assert(isEqualInt(nSwitches, n));
+	assert(isEqualInt(task_id(), nLow));
+
+	// One switch at the unlock, to high and not to medium
+	assert(unlock_mutex(m) == OK);
+	assert(isEqualInt(nSwitches, n + 1));
+	assert(isEqualInt(task_id(), nHigh));
+	n = nSwitches;
+	assert(lock_mutex(m) == OK); // Free, as SRP guarantees
+	assert(unlock_mutex(m) == OK);
+	assert(isEqualInt(nSwitches, n));
+	terminate();
+	assert(isEqualInt(task_id(), nMedium));
+	terminate();
+	assert(isEqualInt(task_id(), nLow));
+
+	assert(remove_mutex(m) == OK);
+	assert(lock_mutex(m2) == OK);
+	assert(remove_mutex(m2) == FAIL);
+	assert(unlock_mutex(m2) == OK);
+	assert(remove_mutex(m2) == OK);
+	assert(pool_stats(POOL_MUTEX, &s) == OK);
+	assert(isEqualInt(s.nUsed, 0));
+	assert(isEqualInt(s.nPeak, 2));
+	return 0;
+}
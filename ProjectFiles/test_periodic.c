@@ -0,0 +1,78 @@
+/* test_periodic.c
+ * Periodic tasks on the host:
+ *   gcc -o test_periodic test_periodic.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c host_stubs.c utest.c
+ * wait_next_period() must release a periodic task exactly one period
+ * after its last release, with the deadline of the new period, however
+ * late the task called it. A release that has already passed must not
+ * block and is counted as jitter. wait_until() must block a task that
+ * is not periodic until the given tick and keep its deadline.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+extern TCB* Tasks[MAX_TASKS];
+
+void TimerInt(void);
+
+uint nCount;
+uint timer0_count(void){ return nCount; }
+uint timer0_tick_counts(void){ return 100; }
+
+void body(void){}
+
+void ticks_to(uint nTick){
+	while(ticks() < nTick)
+		TimerInt();
+}
+
+int main(void)
+{
+	taskstat s, s0;
+	assert(init_kernel() == OK);
+	assert(create_task(body, 1) == OK); // Id 1
+	assert(create_periodic_task(body, 2, 10, 5) == OK); // Id 2, period 0 to 10
+	assert(isEqualInt(Tasks[2]->DeadLine, 5));
+	run();
+
+	// Task 1 is not periodic
+	assert(isEqualInt(task_id(), 1));
+	assert(wait_next_period() == FAIL);
+	assert(wait_until(3) == OK);
+	assert(isEqualInt(task_id(), 2));
+	ticks_to(2);
+	assert(isEqualInt(task_id(), 2));
+	ticks_to(3);
+	assert(isEqualInt(task_id(), 1));
+	assert(isEqualInt(Tasks[1]->DeadLine, 1));
+	terminate();
+
+	// Task 2 ends its first period at tick 3, the next one starts at 10
+	assert(isEqualInt(task_id(), 2));
+	assert(wait_next_period() == OK);
+	assert(isEqualInt(Tasks[2]->DeadLine, 15));
+	assert(isEqualInt(task_id(), 0));
+	ticks_to(9);
+	assert(isEqualInt(task_id(), 0));
+	ticks_to(10);
+	assert(isEqualInt(task_id(), 2));
+
+	// Overrun into the next period, released at 20 without blocking
+	ticks_to(23);
+	assert(task_stats(2, &s0) == OK); // The stubs return from a switch in the next task
+	nCount = 7;
+	assert(wait_next_period() == OK);
+	assert(isEqualInt(task_id(), 2));
+	assert(isEqualInt(Tasks[2]->nRelease, 20));
+	assert(isEqualInt(Tasks[2]->DeadLine, 25));
+	assert(task_stats(2, &s) == OK);
+	assert(isEqualInt(s.nReleases, s0.nReleases + 1));
+	assert(isEqualInt(s.nJitter, 307));
+	assert(isEqualInt(s.nJitterMax, 307));
+
+	// Back in phase, the period after that starts at 30
+	assert(wait_next_period() == OK);
+	assert(isEqualInt(Tasks[2]->DeadLine, 35));
+	ticks_to(30);
+	assert(isEqualInt(task_id(), 2));
+	return 0;
+}
@@ -0,0 +1,74 @@
+/* test_pool.c
+ * Kernel object pools on the host:
+ *   gcc -o test_pool test_pool.c kernel.c readyq.c twheel.c pool.c tlsf.c host_stubs.c utest.c
+ * create_task() and create_mailbox() must fail cleanly when their pool
+ * is exhausted, the counters must follow, and freed objects must be
+ * handed out again. send_wait() and receive_wait() must fail with
+ * interrupts enabled again when no Message struct is left, and
+ * send_wait() also when the heap has no room for the data.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+uint bIsrOff;
+void isr_off(void){ bIsrOff = 1; }
+void isr_on(void){ bIsrOff = 0; }
+
+char big[2 * HEAP_SIZE];
+
+void body(void){}
+
+int main(void)
+{
+	uint i;
+	poolstat s;
+	mailbox* mb[MAX_MAILBOXES];
+	assert(init_kernel() == OK);
+	for(i = 1; i < MAX_TASKS; i++) // Idle holds one TCB
+		assert(create_task(body, 1000 + i) == OK);
+	assert(create_task(body, 1) == FAIL);
+	assert(pool_stats(POOL_TCB, &s) == OK);
+	assert(isEqualInt(s.nUsed, MAX_TASKS));
+	assert(isEqualInt(s.nPeak, MAX_TASKS));
+	assert(isEqualInt(s.nExhausted, 1));
+	assert(pool_stats(NOF_POOLS, &s) == FAIL);
+
+	for(i = 0; i < MAX_MAILBOXES; i++){
+		mb[i] = create_mailbox(4, sizeof(int));
+		assert(mb[i] != NULL);
+	}
+	assert(create_mailbox(4, sizeof(int)) == NULL);
+	assert(pool_stats(POOL_MSG, &s) == OK);
+	assert(isEqualInt(s.nUsed, 2 * MAX_MAILBOXES));
+	assert(no_messages(mb[0]) == OK); // Removes the empty mailbox
+	assert(pool_stats(POOL_MSG, &s) == OK);
+	assert(isEqualInt(s.nUsed, 2 * MAX_MAILBOXES - 2));
+	mb[0] = create_mailbox(4, sizeof(int));
+	assert(mb[0] != NULL);
+	assert(pool_stats(POOL_MAILBOX, &s) == OK);
+	assert(isEqualInt(s.nUsed, MAX_MAILBOXES));
+	assert(isEqualInt(s.nExhausted, 1));
+
+	assert(no_messages(mb[1]) == OK); // Data larger than the heap
+	mb[1] = create_mailbox(1, 2 * HEAP_SIZE);
+	assert(mb[1] != NULL);
+	assert(pool_stats(POOL_MSG, &s) == OK);
+	i = s.nUsed;
+	assert(send_wait(mb[1], big) == FAIL);
+	assert(!bIsrOff);
+	assert(pool_stats(POOL_MSG, &s) == OK);
+	assert(isEqualInt(s.nUsed, i)); // Message struct given back
+
+	assert(no_messages(mb[1]) == OK); // Room for one that holds them all
+	mb[1] = create_mailbox(MAX_MESSAGES, sizeof(int));
+	assert(mb[1] != NULL);
+	for(i = 0; send_no_wait(mb[1], &i) == OK; i++);
+	assert(isEqualInt(i, MAX_MESSAGES - 2 * MAX_MAILBOXES));
+	assert(pool_stats(POOL_MSG, &s) == OK);
+	assert(isEqualInt(s.nUsed, MAX_MESSAGES));
+	assert(send_wait(mb[2], &i) == FAIL);
+	assert(!bIsrOff);
+	assert(receive_wait(mb[3], &i) == FAIL);
+	assert(!bIsrOff);
+	return 0;
+}
@@ -0,0 +1,54 @@
+/* test_stack.c
+ * Per-task stacks on the host:
+ *   gcc -o test_stack test_stack.c kernel.c readyq.c twheel.c pool.c tlsf.c host_stubs.c utest.c
+ * Tasks get the stack size asked for, the high-water mark follows the
+ * deepest word written, and ids are reused after a task terminates.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+extern TCB* Running;
+extern TCB* Tasks[MAX_TASKS];
+
+void body(void){}
+
+int main(void)
+{
+	uint i, nId;
+	stackstat s;
+	assert(init_kernel() == OK);
+	assert(create_task_stack(body, 100, 0) == FAIL);
+	assert(create_task_stack(body, 100, 20) == OK);
+	assert(create_task_stack(body, 200, 500) == OK);
+	assert(create_task(body, 300) == OK);
+	assert(create_task_stack(body, 400, STACK_AREA) == FAIL); // Does not fit
+	run();
+
+	nId = task_id(); // Deadline 100
+	assert(task_stack_usage(nId, &s) == OK);
+	assert(isEqualInt(s.nSize, 20));
+	assert(isEqualInt(s.nPeak, 0));
+	for(i = 0; i < MAX_TASKS; i++){ // Idle and the others
+		if(Tasks[i] && i != nId){
+			assert(task_stack_usage(i, &s) == OK);
+			assert(s.nSize == IDLE_STACK_SIZE || s.nSize == 500 || s.nSize == STACK_SIZE);
+		}
+	}
+
+	Running->SP[0] = 1; // Top word
+	Running->SP[-5] = 2; // Six words deep
+	assert(task_stack_usage(nId, &s) == OK);
+	assert(isEqualInt(s.nPeak, 6));
+	Running->pStack[0] = 3; // Overflowed
+	assert(task_stack_usage(nId, &s) == OK);
+	assert(isEqualInt(s.nPeak, 20));
+
+	terminate();
+	assert(task_stack_usage(nId, &s) == FAIL);
+	assert(task_stack_usage(MAX_TASKS, &s) == FAIL);
+	assert(create_task_stack(body, 50, 30) == OK); // Gets the free id
+	assert(isEqualInt(task_id(), nId));
+	assert(task_stack_usage(nId, &s) == OK);
+	assert(isEqualInt(s.nSize, 30));
+	return 0;
+}
@@ -0,0 +1,71 @@
+/* test_stats.c
+ * Per task run time and scheduling counters on the host:
+ *   gcc -o test_stats test_stats.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c host_stubs.c utest.c
+ * Run time must follow timer0_stamp() between dispatches, a task
+ * switched away from while ready must count a preemption, list times
+ * must add up per list in ticks, and the calling task must see its
+ * current run and list stay.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+extern TCB* Running;
+
+void TimerInt(void);
+
+uint nClock;
+uint timer0_stamp(uint nTicks){ return nClock; }
+
+void body(void){}
+
+int main(void)
+{
+	taskstat s;
+	uint i;
+	assert(init_kernel() == OK);
+	assert(create_task(body, 100) == OK); // Id 1
+	assert(create_task(body, 200) == OK); // Id 2
+	assert(task_stats(MAX_TASKS, &s) == FAIL);
+	assert(task_stats(3, &s) == FAIL);
+	run();
+	assert(isEqualInt(task_id(), 1));
+
+	nClock = 50;
+	set_deadline(300); // Behind task 2
+	assert(isEqualInt(task_id(), 2));
+	assert(task_stats(1, &s) == OK);
+	assert(isEqualInt((uint)s.nRun, 50));
+	assert(isEqualInt(s.nDispatches, 1));
+	assert(isEqualInt(s.nPreemptions, 1));
+
+	nClock = 80;
+	assert(wait(3) == OK); // Task 2 to the Timerlist, not a preemption
+	assert(isEqualInt(task_id(), 1));
+	for(i = 0; i < 3; i++){
+		nClock += 10;
+		TimerInt();
+	}
+	assert(isEqualInt(task_id(), 2)); // Back first, task 1 preempted again
+	nClock = 200;
+	assert(task_stats(2, &s) == OK);
+	assert(isEqualInt((uint)s.nRun, 30 + 90));
+	assert(isEqualInt(s.nDispatches, 2));
+	assert(isEqualInt(s.nPreemptions, 0));
+	assert(isEqualInt(s.nTimer, 3));
+	assert(isEqualInt(s.nReady, 0));
+	assert(isEqualInt(s.nMisses, 0));
+	assert(task_stats(1, &s) == OK);
+	assert(isEqualInt((uint)s.nRun, 50 + 30));
+	assert(isEqualInt(s.nDispatches, 2));
+	assert(isEqualInt(s.nPreemptions, 2));
+	assert(isEqualInt(s.nReady, 3));
+	assert(task_stats(0, &s) == OK); // Idle never ran
+	assert(isEqualInt(s.nDispatches, 0));
+	assert(isEqualInt((uint)s.nRun, 0));
+
+	TimerInt(); // The running task goes on, no new dispatch
+	assert(task_stats(2, &s) == OK);
+	assert(isEqualInt(s.nDispatches, 2));
+	assert(isEqualInt(s.nReady, 1));
+	return 0;
+}
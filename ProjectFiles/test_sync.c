@@ -0,0 +1,114 @@
+/* test_sync.c
+ * Counting semaphores and event flag groups on the host:
+ *   gcc -o test_sync test_sync.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c host_stubs.c utest.c
+ * A semaphore with a count must be taken without a switch, one at 0
+ * must block the caller, and each signal must release the task that
+ * has waited the longest or add to the count. set_event() must release
+ * the waiters whose ANY or ALL mask it satisfies, with the flags that
+ * did it, and EVENT_CLEAR must clear them. A blocked task must leave
+ * the Waitinglist at its deadline. None of it may allocate from a
+ * pool after creation.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+extern TCB* Running;
+
+void RunningContext(void);
+void TimerInt(void);
+
+uint nSwitches;
+void SwitchContext(void){ nSwitches++; RunningContext(); }
+
+void body(void){}
+
+int main(void)
+{
+	semaphore* sem;
+	eventgroup* ev;
+	TCB* pA;
+	TCB* pB;
+	uint n, nFlags, i;
+	poolstat s;
+
+	assert(init_kernel() == OK);
+	assert(create_task(body, 100) == OK); // A
+	assert(create_task(body, 200) == OK); // B
+	assert((sem = create_semaphore(1)) != NULL);
+	assert((ev = create_event()) != NULL);
+	run();
+	pA = Running;
+	assert(isEqualInt(task_id(), 1));
+
+	// Counted, then blocking
+	n = nSwitches;
+	assert(wait_semaphore(sem) == OK);
+	assert(isEqualInt(nSwitches, n));
+	assert(isEqualInt(sem->nCount, 0));
+	wait_semaphore(sem); // A blocks, B runs
+	pB = Running;
+	assert(isEqualInt(task_id(), 2));
+	assert(sem->Waiters.pFirst == pA);
+	signal_semaphore(sem); // A is earlier, preempts
+	assert(Running == pA);
+	assert(sem->Waiters.pFirst == NULL);
+	assert(isEqualInt(sem->nCount, 0));
+
+	// FIFO, not by deadline
+	wait_semaphore(sem); // A
+	wait_semaphore(sem); // B, idle runs
+	assert(isEqualInt(task_id(), 0));
+	assert(sem->Waiters.pFirst == pA && sem->Waiters.pLast == pB);
+	signal_semaphore(sem);
+	assert(Running == pA);
+	n = nSwitches;
+	signal_semaphore(sem); // B is ready, A goes on
+	assert(isEqualInt(nSwitches, n));
+	assert(Running == pA && pB->pWaitOn == NULL);
+	signal_semaphore(sem); // No waiter, counted
+	assert(isEqualInt(sem->nCount, 1));
+	assert(wait_semaphore(sem) == OK);
+
+	// Events already set do not block
+	set_event(ev, 0x2);
+	assert(wait_event(ev, 0x3, EVENT_ANY, &nFlags) == OK);
+	assert(isEqualInt(nFlags, 0x2));
+	assert(wait_event(ev, 0x6, EVENT_ALL, &nFlags) == OK); // Not all set, blocks
+	assert(Running == pB);
+	set_event(ev, 0x1); // Not 0x4, A waits on
+	assert(Running == pB);
+	set_event(ev, 0x4);
+	assert(Running == pA);
+	assert(isEqualInt(pA->nWaitMask, 0x6)); // Flags that ended the wait
+	assert(isEqualInt(ev->nFlags, 0x7));
+	clear_event(ev, 0x7);
+
+	// One set_event releases every satisfied waiter, EVENT_CLEAR
+	wait_event(ev, 0x1, EVENT_ANY | EVENT_CLEAR, NULL); // A
+	wait_event(ev, 0x3, EVENT_ANY, NULL); // B, idle runs
+	set_event(ev, 0x1);
+	assert(Running == pA);
+	assert(pB->pWaitOn == NULL && ev->Waiters.pFirst == NULL);
+	assert(isEqualInt(pB->nWaitMask, 0x1));
+	assert(isEqualInt(ev->nFlags, 0)); // Cleared by A
+	set_event(ev, 0x8); // No waiters left
+	assert(isEqualInt(ev->nFlags, 0x8));
+
+	// Deadline reached while blocked
+	assert(remove_semaphore(sem) == OK);
+	assert((sem = create_semaphore(0)) != NULL);
+	wait_semaphore(sem); // A, B runs
+	assert(Running == pB);
+	assert(remove_semaphore(sem) == FAIL);
+	for(i = 0; i < 100; i++)
+		TimerInt();
+	assert(Running == pA); // Ready again, still queued until it runs
+	assert(sem->Waiters.pFirst == pA);
+
+	assert(pool_stats(POOL_SEMAPHORE, &s) == OK);
+	assert(isEqualInt(s.nPeak, 1));
+	assert(pool_stats(POOL_EVENT, &s) == OK);
+	assert(isEqualInt(s.nUsed, 1));
+	assert(remove_event(ev) == OK);
+	return 0;
+}
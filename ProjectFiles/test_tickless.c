@@ -0,0 +1,96 @@
+/* test_tickless.c
+ * Tickless kernel against a simulated timer0 on the host:
+ *   gcc -DTICKLESS -o test_tickless test_tickless.c kernel.c readyq.c twheel.c pool.c tlsf.c host_stubs.c utest.c
+ * Simulated time advances one tick per loop. The timer interrupt fires
+ * when the programmed shot has elapsed. ticks() must follow simulated
+ * time exactly, tasks must leave the Timerlist and Waitinglist on their
+ * exact tick, and far fewer interrupts than ticks must be taken.
+ */
+#include "kernel.h"
+#include "utest.h"
+#include <limits.h>
+
+#define NTASKS  8
+#define TICKS   400
+
+extern struct threeLists{
+	list* waiting;
+	list* ready;
+	list* timer;
+}List;
+
+void TimerInt(void);
+void RunningContext(void);
+listobj* extract(listobj* pObj);
+void insert(list* mylist, listobj* pObj);
+listobj* first(list* mylist);
+
+/* Simulated timer0 */
+uint simNow;            // Current tick
+uint simLast;           // Tick of the last interrupt
+uint simShot;           // Ticks programmed after simLast
+uint nInterrupts;
+
+void timer0_start(void){ simLast = simNow; simShot = 1; }
+void timer0_oneshot(uint nTicks){ assert(nTicks > simNow - simLast); simShot = nTicks; }
+uint timer0_elapsed(void){ return simNow - simLast; }
+
+listobj* task[NTASKS];
+uint expire[NTASKS];    // Tick the task should reach the Readylist
+
+void body(void){}
+
+void check(void){
+	uint i;
+	for(i = 0; i < NTASKS; i++){
+		if(simNow < expire[i])
+			assert(isNotEqualPointer(task[i]->pList, List.ready));
+		else if(simNow == expire[i])
+			assert(isEqualPointer(task[i]->pList, List.ready));
+	}
+}
+
+int main(void)
+{
+	uint i;
+	assert(init_kernel() == OK);
+	for(i = 0; i < NTASKS; i++)
+		assert(create_task(body, 1000 + i) == OK);
+	run();
+	for(i = 0; i < NTASKS; i++){
+		task[i] = extract(first(List.ready));
+		if(i % 2){ // On the Timerlist, as after wait()
+			task[i]->nTCnt = expire[i] = 3 + 37 * i;
+			insert(List.timer, task[i]);
+		}else{ // Blocked on a mailbox, released at its deadline
+			task[i]->pTask->DeadLine = expire[i] = 5 + 41 * i;
+			insert(List.waiting, task[i]);
+		}
+	}
+	RunningContext();
+
+	while(simNow < TICKS){
+		simNow++;
+		if(simNow - simLast == simShot){
+			nInterrupts++;
+			simLast = simNow;
+			TimerInt();
+		}
+		assert(isEqualInt(ticks(), simNow));
+		check();
+		if(simNow == 100){ // Mid-shot arm, earlier than the programmed shot
+			listobj* pObj = extract(task[1]);
+			pObj->nTCnt = expire[1] = simNow + 2;
+			insert(List.timer, pObj);
+			RunningContext();
+		}
+	}
+	for(i = 0; i < NTASKS; i++)
+		assert(isEqualPointer(task[i]->pList, List.ready));
+	assert(nInterrupts < TICKS / 4);
+
+	simNow++; // Time base moved mid-shot
+	set_ticks(1000);
+	assert(isEqualInt(ticks(), 1000));
+	return 0;
+}
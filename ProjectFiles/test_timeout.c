@@ -0,0 +1,110 @@
+/* test_timeout.c
+ * Deadline ordered mailbox waiters and timed waits on the host:
+ *   gcc -o test_timeout test_timeout.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c host_stubs.c utest.c
+ * A blocked task must be queued in the mailbox by its deadline, so a
+ * late arrival with an earlier deadline gets the next Message. A timed
+ * wait must leave the Timerlist after its limit and return TIMEOUT,
+ * or at its deadline if that comes first and return DEADLINE_REACHED,
+ * and either way leave nothing in the mailbox. A Message taken within
+ * the limit must return OK.
+ * Stubbed, the code after SwitchContext() runs as the next task, so
+ * the test calls end_msg_wait() itself as the woken task.
+ */
+#include "kernel.h"
+#include "utest.h"
+
+extern TCB* Running;
+
+void TimerInt(void);
+exception end_msg_wait(mailbox* mBox, uint nTicks, const char* pCall);
+
+void body(void){}
+
+int main(void)
+{
+	mailbox* mb;
+	mailbox* mbEmpty;
+	TCB* pA;
+	TCB* pB;
+	TCB* pC;
+	TCB* pD;
+	int x = 0, v = 7;
+	uint i;
+	taskstat s;
+	poolstat p;
+
+	assert(init_kernel() == OK);
+	assert(create_task(body, 100) == OK); // A
+	assert(create_task(body, 200) == OK); // B
+	assert(create_task(body, 300) == OK); // C
+	assert((mb = create_mailbox(4, sizeof(int))) != NULL);
+	assert((mbEmpty = create_mailbox(4, sizeof(int))) != NULL);
+	run();
+	pA = Running;
+
+	// D, deadline 50, blocks after A and is served first
+	receive_wait(mb, &x); // A blocks, B runs
+	pB = Running;
+	assert(create_task(body, 50) == OK); // D preempts B
+	pD = Running;
+	receive_wait(mb, &x); // D blocks, B runs
+	assert(Running == pB);
+	assert(mb->pHead->pNext->pBlock == &pD->Node);
+	assert(mb->pTail->pPrevious->pBlock == &pA->Node);
+	v = 1;
+	assert(send_no_wait(mb, &v) == OK);
+	assert(Running == pD);
+	assert(pD->Node.pMessage == NULL);
+	assert(isEqualInt(mb->nBlockedMsg, -1)); // A waits on
+	terminate();
+	assert(Running == pB);
+
+	// The limit comes first
+	receive_wait_timeout(mbEmpty, &x, 5); // C runs
+	pC = Running;
+	assert(pC != pB);
+	assert(isEqualInt(pB->Node.nTCnt, 5));
+	for(i = 0; i < 4; i++)
+		TimerInt();
+	assert(Running == pC);
+	TimerInt();
+	assert(Running == pB);
+	assert(end_msg_wait(mbEmpty, 5, "receive_wait_timeout") == TIMEOUT);
+	assert(isEqualInt(mbEmpty->nBlockedMsg, 0));
+	assert(isEqualInt(mbEmpty->nMessages, 0));
+	assert(task_stats(pB->nId, &s) == OK);
+	assert(isEqualInt(s.nMisses, 0));
+	assert(isEqualInt(s.nTimer, 5));
+
+	// The deadline comes first
+	receive_wait_timeout(mbEmpty, &x, 1000);
+	assert(isEqualInt(pB->Node.nTCnt, 200));
+	while(Running != pB){
+		if(Running == pA) terminate(); // Its deadline passed at 100
+		else TimerInt();
+	}
+	assert(isEqualInt(ticks(), 200));
+	assert(end_msg_wait(mbEmpty, 1000, "receive_wait_timeout") == DEADLINE_REACHED);
+	assert(isEqualInt(mbEmpty->nBlockedMsg, 0));
+	assert(task_stats(pB->nId, &s) == OK);
+	assert(isEqualInt(s.nMisses, 1));
+	terminate();
+
+	// Taken within the limit, the timer entry goes with it
+	assert(Running == pC);
+	v = 2;
+	send_wait_timeout(mbEmpty, &v, 10); // Idle runs
+	assert(isEqualInt(task_id(), 0));
+	assert(receive_no_wait(mbEmpty, &x) == OK);
+	assert(isEqualInt(x, 2));
+	assert(Running == pC);
+	assert(pC->Node.pMessage == NULL);
+	assert(end_msg_wait(mbEmpty, 10, "receive_wait_timeout") == OK);
+	for(i = 0; i < 20; i++)
+		TimerInt();
+	assert(Running == pC);
+	assert(isEqualInt(mbEmpty->nMessages, 0));
+	assert(pool_stats(POOL_MSG, &p) == OK);
+	assert(isEqualInt(p.nUsed, 2 * 2 + 1)); // Mailbox heads and tails, and A's
+	return 0;
+}
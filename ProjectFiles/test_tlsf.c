@@ -0,0 +1,66 @@
+/* test_tlsf.c
+ * Message data allocator on the host:
+ *   gcc -o test_tlsf test_tlsf.c tlsf.c utest.c
+ * Random allocations and frees of mixed sizes. Live blocks must keep
+ * their contents, the counters must add up, and once everything is
+ * freed the arena must have merged back into one block.
+ */
+#include "kernel.h"
+#include "tlsf.h"
+#include "utest.h"
+#include <string.h>
+
+#define ARENA   8192
+#define SLOTS   64
+#define ROUNDS  100000
+
+tlsf t;
+char arena[ARENA + 3];
+char* p[SLOTS];
+uint size[SLOTS];
+
+int main(void)
+{
+	uint i, j, r = 1;
+	heapstat init, s;
+	assert(tlsf_init(&t, arena + 3, ARENA) == OK); // Unaligned arena
+	tlsf_stats(&t, &init);
+	assert(isEqualInt(init.nUsed, 0));
+	assert(isEqualInt(init.nFree, init.nSize));
+	assert(init.nLargestFree > ARENA - 64);
+
+	for(i = 0; i < ROUNDS; i++){
+		r = r * 1103515245 + 12345;
+		j = (r >> 8) % SLOTS;
+		if(p[j]){
+			uint k;
+			for(k = 0; k < size[j]; k++)
+				assert(p[j][k] == (char)(j + k));
+			tlsf_free(&t, p[j]);
+			p[j] = NULL;
+		}else{
+			size[j] = 1 + (r >> 16) % 300;
+			p[j] = (char*)tlsf_alloc(&t, size[j]);
+			if(p[j]){
+				uint k;
+				assert(((size_t)p[j] & 7) == 0);
+				for(k = 0; k < size[j]; k++)
+					p[j][k] = (char)(j + k);
+			}
+		}
+		tlsf_stats(&t, &s);
+		assert(s.nUsed + s.nFree == s.nSize);
+		assert(s.nLargestFree <= s.nFree);
+	}
+	assert(s.nPeak > ARENA / 2);
+	for(j = 0; j < SLOTS; j++)
+		tlsf_free(&t, p[j]);
+	tlsf_stats(&t, &s);
+	assert(isEqualInt(s.nUsed, 0));
+	assert(isEqualInt(s.nLargestFree, init.nLargestFree));
+
+	assert(tlsf_alloc(&t, ARENA) == NULL);
+	tlsf_stats(&t, &s);
+	assert(s.nExhausted > 0);
+	return 0;
+}
@@ -0,0 +1,92 @@
+/* test_trace.c
+ * Scheduler trace on the host:
+ *   gcc -DTRACE -o test_trace test_trace.c kernel.c readyq.c twheel.c pool.c tlsf.c trace.c host_stubs.c utest.c
+ * Each list move, task switch, tick and mailbox call must leave one
+ * record with its task, mailbox and deadline, in order. The ring must
+ * keep the newest TRACE_SIZE records and trace_enable() must stop and
+ * start recording.
+ */
+#include "kernel.h"
+#include "trace.h"
+#include "utest.h"
+#include <limits.h>
+
+extern TCB* Running;
+
+void TimerInt(void);
+
+uint nCount;
+uint timer0_count(void){ return nCount; }
+uint timer0_tick_counts(void){ return 100; }
+
+void body(void){}
+
+uint nNext; // Record to check next
+
+tracerec* next(uint nEvent, uint nTask, uint nArg){
+	tracerec* pRec = &Trace.Rec[nNext++ % TRACE_SIZE];
+	assert(isEqualInt(pRec->nEvent, nEvent));
+	assert(isEqualInt(pRec->nTask, nTask));
+	assert(isEqualInt(pRec->nArg, nArg));
+	return pRec;
+}
+
+int main(void)
+{
+	mailbox* mb;
+	tracerec* pRec;
+	uint i, x = 0, Items[3] = {1, 2, 3};
+
+	assert(init_kernel() == OK);
+	assert(isEqualInt(Trace.nMagic, TRACE_MAGIC));
+	assert(isEqualInt(Trace.nTickCounts, 100));
+	pRec = next(TR_INSERT, 0, TR_READY_LIST); // Idle
+	assert(isEqualInt(pRec->nDeadline, UINT_MAX));
+	assert(isEqualInt(pRec->nMailbox, TR_NONE));
+	assert(create_task(body, 100) == OK);
+	assert(isEqualInt(next(TR_INSERT, 1, TR_READY_LIST)->nDeadline, 100));
+	run();
+	next(TR_RUN, 1, 0);
+
+	// Mailbox calls, the caller stays first
+	assert((mb = create_mailbox(4, sizeof(uint))) != NULL);
+	nCount = 42;
+	assert(send_no_wait(mb, &x) == OK);
+	pRec = next(TR_SEND_NO_WAIT, 1, 1);
+	assert(isEqualInt(pRec->nMailbox, mb->nId));
+	assert(isEqualInt(pRec->nDeadline, 100));
+	assert(isEqualInt(pRec->nCount, 42));
+	assert(isEqualInt(send_no_wait_n(mb, Items, 3), 3));
+	next(TR_SEND_NO_WAIT, 1, 3);
+	assert(isEqualInt(receive_no_wait_n(mb, Items, 3), 3));
+	next(TR_RECEIVE_NO_WAIT, 1, 3);
+	assert(isEqualInt(nNext, Trace.nHead));
+
+	// wait(2): to the Timerlist, idle runs, back after two ticks
+	assert(wait(2) == OK);
+	next(TR_EXTRACT, 1, TR_READY_LIST);
+	next(TR_INSERT, 1, TR_TIMER_LIST);
+	next(TR_RUN, 0, 0);
+	TimerInt();
+	assert(isEqualInt(next(TR_TICK, 0, 1)->nTick, 1));
+	next(TR_RUN, 0, 0);
+	TimerInt();
+	next(TR_TICK, 0, 1);
+	next(TR_EXTRACT, 1, TR_TIMER_LIST);
+	next(TR_INSERT, 1, TR_READY_LIST);
+	next(TR_RUN, 1, 0);
+	assert(isEqualInt(nNext, Trace.nHead));
+
+	// Stopped, then the ring wraps and keeps the newest records
+	trace_enable(FALSE);
+	assert(send_no_wait(mb, &x) == OK);
+	assert(isEqualInt(nNext, Trace.nHead));
+	trace_enable(TRUE);
+	for(i = 0; i < TRACE_SIZE + 3; i++)
+		assert(receive_no_wait(mb, &x) == (i < 2 ? OK : FAIL)); // One left from the batch
+	nNext += 3;
+	for(i = 0; i < TRACE_SIZE; i++)
+		next(TR_RECEIVE_NO_WAIT, 1, 1);
+	assert(isEqualInt(nNext, Trace.nHead));
+	return 0;
+}
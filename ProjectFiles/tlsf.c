@@ -0,0 +1,191 @@
+// tlsf.c
+// Two-level segregated fit allocator over one arena, used for message
+// payloads. Free blocks are kept in size classes: the first level is
+// the power of two of the size, the second level splits that range in
+// TLSF_SL_COUNT equal parts. A bitmap per level finds a non-empty
+// class that is large enough with two find-first-set operations, so
+// alloc and free are O(1) whatever the state of the arena. A request
+// is rounded up to the next class boundary, so any block in the class
+// found fits without searching the list. Freed blocks are merged with
+// free physical neighbours at once. The arena ends with a used block
+// of size 0 so the last block needs no special case.
+
+#include "tlsf.h"
+#include <stddef.h>
+#include <string.h>
+
+#define BLOCK_HDR       offsetof(tlsf_block, pNextFree)
+#define BLOCK_MIN       (sizeof(tlsf_block) - BLOCK_HDR)
+#define FREE_BIT        1U
+#define PREV_FREE_BIT   2U
+#define ALIGN_MASK      ((1U << TLSF_ALIGN_SHIFT) - 1)
+
+#define SIZE(b)         ((b)->nSize & ~3U)
+#define NEXT(b)         ((tlsf_block*)((char*)(b) + BLOCK_HDR + SIZE(b)))
+#define PAYLOAD(b)      ((void*)((char*)(b) + BLOCK_HDR))
+#define BLOCK(p)        ((tlsf_block*)((char*)(p) - BLOCK_HDR))
+
+static uint tlsf_ffs(uint x){
+	//Index of the lowest set bit, x != 0
+#if defined(__GNUC__)
+	return __builtin_ctz(x);
+#else
+	static const unsigned char DeBruijn[32] = {
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9};
+	return DeBruijn[((x & (0U - x)) * 0x077CB531U) >> 27];
+#endif
+}
+
+static uint tlsf_fls(uint x){
+	//Index of the highest set bit, x != 0
+#if defined(__GNUC__)
+	return 31 - __builtin_clz(x);
+#else
+	uint n = 0;
+	if(x & 0xffff0000U){ n += 16; x >>= 16; }
+	if(x & 0xff00U){ n += 8; x >>= 8; }
+	if(x & 0xf0U){ n += 4; x >>= 4; }
+	if(x & 0xcU){ n += 2; x >>= 2; }
+	return n + (x >> 1);
+#endif
+}
+
+static void mapping(uint nSize, uint* pFl, uint* pSl){
+	//Size class holding blocks of nSize bytes
+	if(nSize < (1U << TLSF_FL_SHIFT)){
+		*pFl = 0;
+		*pSl = nSize >> TLSF_ALIGN_SHIFT;
+	}else{
+		uint f = tlsf_fls(nSize);
+		*pFl = f - TLSF_FL_SHIFT + 1;
+		*pSl = (nSize >> (f - TLSF_SL_BITS)) ^ TLSF_SL_COUNT;
+	}
+}
+
+static void insert_free(tlsf* t, tlsf_block* b){
+	uint fl, sl;
+	tlsf_block* pHead;
+	mapping(SIZE(b), &fl, &sl);
+	pHead = t->pFree[fl][sl];
+	b->pPrevFree = NULL;
+	b->pNextFree = pHead;
+	if(pHead) pHead->pPrevFree = b;
+	t->pFree[fl][sl] = b;
+	t->SlBitmap[fl] |= 1U << sl;
+	t->FlBitmap |= 1U << fl;
+}
+
+static void remove_free(tlsf* t, tlsf_block* b){
+	uint fl, sl;
+	mapping(SIZE(b), &fl, &sl);
+	if(b->pNextFree) b->pNextFree->pPrevFree = b->pPrevFree;
+	if(b->pPrevFree){
+		b->pPrevFree->pNextFree = b->pNextFree;
+	}else{
+		t->pFree[fl][sl] = b->pNextFree;
+		if(!b->pNextFree){
+			t->SlBitmap[fl] &= ~(1U << sl);
+			if(!t->SlBitmap[fl]) t->FlBitmap &= ~(1U << fl);
+		}
+	}
+}
+
+static tlsf_block* find_suitable(tlsf* t, uint nSize){
+	//First free block of a class whose every block holds nSize
+	uint fl, sl, bits;
+	if(nSize >= (1U << TLSF_FL_SHIFT))
+		nSize += (1U << (tlsf_fls(nSize) - TLSF_SL_BITS)) - 1; //Round up to the next class
+	mapping(nSize, &fl, &sl);
+	if(fl >= TLSF_FL_COUNT) return NULL;
+	bits = t->SlBitmap[fl] & (~0U << sl);
+	if(!bits){
+		bits = t->FlBitmap & (~0U << fl) & ~(1U << fl);
+		if(!bits) return NULL;
+		fl = tlsf_ffs(bits);
+		bits = t->SlBitmap[fl];
+	}
+	return t->pFree[fl][tlsf_ffs(bits)];
+}
+
+exception tlsf_init(tlsf* t, void* pArena, uint nBytes){
+	//Make the whole arena one free block followed by the end block
+	uint nAdjust = (0U - (uint)(size_t)pArena) & ALIGN_MASK;
+	tlsf_block* pEnd;
+	uint nSize;
+	memset(t, 0, sizeof(tlsf));
+	if(nBytes < nAdjust + 2 * BLOCK_HDR + BLOCK_MIN) return FAIL;
+	nSize = (nBytes - nAdjust - 2 * BLOCK_HDR) & ~ALIGN_MASK;
+	if(nSize >= (1U << TLSF_MAX_BITS)) nSize = (1U << TLSF_MAX_BITS) - (1U << TLSF_ALIGN_SHIFT);
+	t->pFirst = (tlsf_block*)((char*)pArena + nAdjust);
+	t->pFirst->nSize = nSize | FREE_BIT;
+	pEnd = NEXT(t->pFirst);
+	pEnd->nSize = PREV_FREE_BIT;
+	pEnd->pPrevPhys = t->pFirst;
+	insert_free(t, t->pFirst);
+	t->Stat.nSize = nSize + BLOCK_HDR;
+	return OK;
+}
+
+void* tlsf_alloc(tlsf* t, uint nSize){
+	//nSize bytes, or NULL if no free block is large enough
+	tlsf_block* b;
+	nSize = (nSize + ALIGN_MASK) & ~ALIGN_MASK;
+	if(nSize < BLOCK_MIN) nSize = BLOCK_MIN;
+	b = nSize < (1U << TLSF_MAX_BITS) ? find_suitable(t, nSize) : NULL;
+	if(!b){
+		t->Stat.nExhausted++;
+		return NULL;
+	}
+	remove_free(t, b);
+	if(SIZE(b) >= nSize + BLOCK_HDR + BLOCK_MIN){ //Split, the rest stays free
+		tlsf_block* pRest = (tlsf_block*)((char*)PAYLOAD(b) + nSize);
+		pRest->nSize = (SIZE(b) - nSize - BLOCK_HDR) | FREE_BIT;
+		NEXT(pRest)->pPrevPhys = pRest;
+		b->nSize = nSize | (b->nSize & PREV_FREE_BIT);
+		insert_free(t, pRest);
+	}else{
+		b->nSize &= ~FREE_BIT;
+		NEXT(b)->nSize &= ~PREV_FREE_BIT;
+	}
+	t->Stat.nUsed += SIZE(b) + BLOCK_HDR;
+	if(t->Stat.nUsed > t->Stat.nPeak) t->Stat.nPeak = t->Stat.nUsed;
+	return PAYLOAD(b);
+}
+
+void tlsf_free(tlsf* t, void* pData){
+	tlsf_block* b;
+	tlsf_block* pNext;
+	if(!pData) return;
+	b = BLOCK(pData);
+	t->Stat.nUsed -= SIZE(b) + BLOCK_HDR;
+	b->nSize |= FREE_BIT;
+	if(b->nSize & PREV_FREE_BIT){ //Merge with the previous block
+		tlsf_block* pPrev = b->pPrevPhys;
+		remove_free(t, pPrev);
+		pPrev->nSize += SIZE(b) + BLOCK_HDR;
+		b = pPrev;
+	}
+	pNext = NEXT(b);
+	if(pNext->nSize & FREE_BIT){ //Merge with the next block
+		remove_free(t, pNext);
+		b->nSize += SIZE(pNext) + BLOCK_HDR;
+		pNext = NEXT(b);
+	}
+	pNext->nSize |= PREV_FREE_BIT;
+	pNext->pPrevPhys = b;
+	insert_free(t, b);
+}
+
+void tlsf_stats(tlsf* t, heapstat* pStat){
+	//The largest free block is in the highest non-empty class
+	*pStat = t->Stat;
+	pStat->nFree = t->Stat.nSize - t->Stat.nUsed;
+	pStat->nLargestFree = 0;
+	if(t->FlBitmap){
+		uint fl = tlsf_fls(t->FlBitmap);
+		tlsf_block* b = t->pFree[fl][tlsf_fls(t->SlBitmap[fl])];
+		for(; b; b = b->pNextFree)
+			if(SIZE(b) > pStat->nLargestFree) pStat->nLargestFree = SIZE(b);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef TLSF_H
+#define TLSF_H
+
+#include "kernel.h"
+
+/*********************************************************/
+/** Two-level segregated fit allocator for payloads      */
+/*********************************************************/
+
+#define TLSF_ALIGN_SHIFT        3                       // 8 byte granularity
+#define TLSF_SL_BITS            4                       // log2 of second level classes
+#define TLSF_MAX_BITS           20                      // Largest block < 2^TLSF_MAX_BITS
+#define TLSF_FL_SHIFT           (TLSF_SL_BITS + TLSF_ALIGN_SHIFT)
+#define TLSF_FL_COUNT           (TLSF_MAX_BITS - TLSF_FL_SHIFT + 1)
+#define TLSF_SL_COUNT           (1 << TLSF_SL_BITS)
+
+typedef struct tlsf_block {
+        struct tlsf_block       *pPrevPhys;     // Valid when the previous block is free
+        uint                    nSize;          // Payload bytes, bit 0 free, bit 1 previous free
+        struct tlsf_block       *pNextFree;     // Free blocks only, overlaps the payload
+        struct tlsf_block       *pPrevFree;
+} tlsf_block;
+
+typedef struct {
+        uint            FlBitmap;                       // Bit f set if SlBitmap[f] != 0
+        uint            SlBitmap[TLSF_FL_COUNT];        // Bit s set if pFree[f][s] != NULL
+        tlsf_block      *pFree[TLSF_FL_COUNT][TLSF_SL_COUNT];
+        tlsf_block      *pFirst;                        // First physical block
+        heapstat        Stat;
+} tlsf;
+
+exception       tlsf_init( tlsf* t, void* pArena, uint nBytes );
+void*           tlsf_alloc( tlsf* t, uint nSize );
+void            tlsf_free( tlsf* t, void* pData );
+void            tlsf_stats( tlsf* t, heapstat* pStat );
+
+#endif
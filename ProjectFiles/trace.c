@@ -0,0 +1,53 @@
+#include "trace.h"
+#include "kernel_hwdep.h"
+#include <string.h>
+
+/*********************************************************/
+/** Scheduler trace                                      */
+/*********************************************************/
+
+// trace_put() is only called by the kernel with interrupts off, the
+// single writer needs no lock. A dump is a copy of Trace, taken by the
+// debugger on the board or written to a file on the host, and turned
+// into a timeline by trace2json.c.
+
+#ifdef TRACE
+
+typedef char check_size[(TRACE_SIZE & (TRACE_SIZE - 1)) == 0 ? 1 : -1];
+
+extern uint tickCounter;
+
+tracebuf Trace;
+
+void trace_init(void){
+	//Empty the trace and start recording
+	memset(&Trace, 0, sizeof(Trace));
+	Trace.nMagic = TRACE_MAGIC;
+	Trace.nSize = TRACE_SIZE;
+	Trace.nTickUs = TIMER0_TICK_US;
+	Trace.nTickCounts = timer0_tick_counts();
+	Trace.bOn = TRUE;
+}
+
+void trace_enable(bool bOn){
+	//Stop recording while a dump is taken, or start again
+	Trace.bOn = bOn;
+}
+
+void trace_put(uint nEvent, TCB* pTask, mailbox* mBox, uint nArg){
+	//Write one record over the oldest one
+	tracerec* pRec;
+	if(!Trace.bOn) return;
+	pRec = &Trace.Rec[Trace.nHead++ & (TRACE_SIZE - 1)];
+	pRec->nTick = tickCounter;
+	pRec->nCount = timer0_count();
+	pRec->nEvent = nEvent;
+	pRec->nTask = pTask ? pTask->nId : TR_NONE;
+	pRec->nDeadline = pTask ? pTask->DeadLine : 0;
+	pRec->nMailbox = mBox ? mBox->nId : TR_NONE;
+	pRec->nArg = nArg;
+	if(nEvent == TR_TICK)
+		Trace.nTickCounts = timer0_tick_counts(); //Host: measured, may change
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "kernel.h"
+
+/*********************************************************/
+/** Scheduler trace, compiled in with TRACE              */
+/*********************************************************/
+
+#ifndef TRACE_SIZE
+#define TRACE_SIZE      512     // Records, a power of two
+#endif
+#define TRACE_MAGIC     0x31435254      // "TRC1", first word of a dump
+
+// Events
+#define TR_TICK         1       // TimerInt(), nArg ticks since the last one
+#define TR_RUN          2       // Task loaded by RunningContext() or TimerInt()
+#define TR_INSERT       3       // Task put in list nArg, TR_xxx_LIST
+#define TR_EXTRACT      4       // Task taken out of list nArg
+#define TR_SEND_WAIT    5       // Mailbox calls, nArg Messages
+#define TR_RECEIVE_WAIT 6
+#define TR_SEND_NO_WAIT 7
+#define TR_RECEIVE_NO_WAIT 8
+#define TR_DEADLINE     9       // send_wait/receive_wait gave DEADLINE_REACHED
+#define TR_TIMEOUT      10      // xxx_wait_timeout() gave TIMEOUT
+
+#define TR_READY_LIST   0
+#define TR_WAITING_LIST 1
+#define TR_TIMER_LIST   2
+
+#define TR_NONE         0xffff  // No task or mailbox
+
+// One event, 20 bytes. The time is nTick + nCount / nTickCounts ticks.
+typedef struct {
+        uint            nTick;          // Tick counter
+        uint            nCount;         // timer0_count() into the tick
+        uint            nDeadline;      // Deadline of the task, 0 if none
+        unsigned short  nEvent;         // TR_xxx
+        unsigned short  nTask;          // Task id, see task_id()
+        unsigned short  nMailbox;       // Mailbox id, see create_mailbox()
+        unsigned short  nArg;
+} tracerec;
+
+// The trace as kept in memory, also the format of a dump. Record
+// nHead % TRACE_SIZE is written next, nHead counts all records so the
+// oldest one kept is nHead - TRACE_SIZE once it has wrapped.
+typedef struct {
+        uint            nMagic;         // TRACE_MAGIC
+        uint            nSize;          // TRACE_SIZE
+        uint            nHead;
+        uint            nTickUs;        // Microseconds per tick
+        uint            nTickCounts;    // timer0_count() per tick
+        uint            bOn;            // Records are written
+        tracerec        Rec[TRACE_SIZE];
+} tracebuf;
+
+extern tracebuf Trace;
+
+void            trace_init( void );
+void            trace_enable( bool bOn );
+void            trace_put( uint nEvent, TCB* pTask, mailbox* mBox, uint nArg );
+
+#ifdef TRACE
+#define TRACE_EVENT(e, t, m, a)         trace_put((e), (t), (m), (a))
+#else
+#define TRACE_EVENT(e, t, m, a)         ((void)0)
+#endif
+
+#endif
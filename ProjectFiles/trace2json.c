@@ -0,0 +1,126 @@
+/* trace2json.c
+ * Turns a trace dump into a timeline for ui.perfetto.dev or
+ * chrome://tracing, in the Trace Event JSON format:
+ *   make host/trace2json
+ *   host/trace2json kernel.trace > kernel.json
+ * A dump is the tracebuf of trace.h, written by the host port at exit
+ * (KERNEL_TRACE=kernel.trace) or saved from the board by the debugger,
+ * both little endian. Each task is a thread: a slice while it runs and
+ * an instant for each of its list moves and mailbox calls. Ticks are on
+ * a thread of their own.
+ */
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PID     1
+#define TID_TICK        TR_NONE
+
+static const char* pName[] = {"", "tick", "run", "insert", "extract", "send_wait",
+	"receive_wait", "send_no_wait", "receive_no_wait", "deadline", "timeout"};
+static const char* pList[] = {"ready", "waiting", "timer"};
+
+static uint nTickUs, nTickCounts;
+static uint bFirst = TRUE;
+
+static double time_us(tracerec* pRec){
+	double t = (double)pRec->nTick * nTickUs;
+	if(nTickCounts) t += (double)pRec->nCount * nTickUs / nTickCounts;
+	return t;
+}
+
+static void begin(void){
+	printf(bFirst ? "\n" : ",\n");
+	bFirst = FALSE;
+}
+
+static void name(uint nTid, const char* pText){
+	begin();
+	printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+	       PID, nTid, pText);
+}
+
+int main(int argc, char* argv[])
+{
+	FILE* f;
+	uint Header[6], nHead, nSize, nFirst, i;
+	tracerec* pRec;
+	static uint bNamed[TR_NONE + 1];
+	uint nRunning = TR_NONE;
+	double tRun = 0, t = 0;
+
+	if(argc != 2){
+		fprintf(stderr, "usage: trace2json dump > out.json\n");
+		return 1;
+	}
+	if(!(f = fopen(argv[1], "rb")) || fread(Header, sizeof(Header), 1, f) != 1
+	   || Header[0] != TRACE_MAGIC){
+		fprintf(stderr, "trace2json: %s is not a trace dump\n", argv[1]);
+		return 1;
+	}
+	nSize = Header[1];
+	nHead = Header[2];
+	nTickUs = Header[3];
+	nTickCounts = Header[4];
+	pRec = malloc(nSize * sizeof(tracerec));
+	if(!pRec || fread(pRec, sizeof(tracerec), nSize, f) != nSize){
+		fprintf(stderr, "trace2json: %s is short\n", argv[1]);
+		return 1;
+	}
+	fclose(f);
+	nFirst = nHead > nSize ? nHead - nSize : 0; //Oldest record kept
+
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	begin();
+	printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"kernel\"}}", PID);
+	name(TID_TICK, "timer");
+	for(i = nFirst; i != nHead; i++){
+		tracerec* r = &pRec[i % nSize];
+		t = time_us(r);
+		if(r->nTask != TR_NONE && !bNamed[r->nTask]){
+			char szName[16];
+			bNamed[r->nTask] = TRUE;
+			sprintf(szName, "%s %u", r->nDeadline == 0xffffffff ? "idle" : "task", r->nTask);
+			name(r->nTask, szName);
+		}
+		switch(r->nEvent){
+		case TR_TICK:
+			begin();
+			printf("{\"name\":\"tick\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+			       "\"args\":{\"tick\":%u,\"ticks\":%u}}", t, PID, TID_TICK, r->nTick, r->nArg);
+			break;
+		case TR_RUN:
+			if(r->nTask == nRunning) break; //Same task goes on after a tick
+			if(nRunning != TR_NONE){
+				begin();
+				printf("{\"name\":\"run\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+				       tRun, t - tRun, PID, nRunning);
+			}
+			nRunning = r->nTask;
+			tRun = t;
+			break;
+		case TR_INSERT:
+		case TR_EXTRACT:
+			begin();
+			printf("{\"name\":\"%s %s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+			       "\"args\":{\"deadline\":%u}}", pName[r->nEvent],
+			       r->nArg < 3 ? pList[r->nArg] : "?", t, PID, r->nTask, r->nDeadline);
+			break;
+		default:
+			if(r->nEvent < TR_SEND_WAIT || r->nEvent > TR_TIMEOUT) break;
+			begin();
+			printf("{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u,"
+			       "\"args\":{\"mailbox\":%u,\"n\":%u,\"deadline\":%u}}", pName[r->nEvent], t, PID,
+			       r->nTask, r->nMailbox, r->nArg, r->nDeadline);
+			break;
+		}
+	}
+	if(nRunning != TR_NONE){ //Up to the last record
+		begin();
+		printf("{\"name\":\"run\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u}",
+		       tRun, t - tRun, PID, nRunning);
+	}
+	printf("\n]}\n");
+	free(pRec);
+	return 0;
+}
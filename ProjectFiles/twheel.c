@@ -0,0 +1,178 @@
+// twheel.c
+// Hierarchical timing wheel for the Timerlist, keyed on listobj::nTCnt.
+// Level L holds the items whose expiry tick first differs from the
+// current tick in bit group L (TW_BITS bits per group), in the slot
+// given by that group of the expiry tick. Arm and cancel are O(1).
+// When the current tick passes a level boundary the matching slot of
+// the level above is cascaded down, and level 0 then holds exactly the
+// items that expire on the current tick. A bitmap per level gives the
+// next slot in use for tw_next().
+
+#include "twheel.h"
+#include <stdlib.h>
+
+static uint tw_ffs(uint x){
+	//Index of the lowest set bit, x != 0
+#if defined(__GNUC__)
+	return __builtin_ctz(x);
+#else
+	static const unsigned char DeBruijn[32] = {
+		0, 1, 28, 2, 29, 14, 24, 3, 30, 22, 20, 15, 25, 17, 4, 8,
+		31, 27, 13, 23, 21, 19, 16, 7, 26, 12, 18, 6, 11, 5, 10, 9};
+	return DeBruijn[((x & (0U - x)) * 0x077CB531U) >> 27];
+#endif
+}
+
+static void slot_push(twheel* w, uint level, uint slot, listobj* pObj){
+	listobj** ppHead = &w->pSlot[level][slot];
+	listobj* pHead = *ppHead;
+	w->Bitmap[level][slot >> 5] |= 1U << (slot & 31);
+	if(!pHead){
+		pObj->pNext = pObj->pPrevious = pObj;
+	}else{
+		pObj->pNext = pHead;
+		pObj->pPrevious = pHead->pPrevious;
+		pHead->pPrevious->pNext = pObj;
+		pHead->pPrevious = pObj;
+	}
+	*ppHead = pObj;
+}
+
+static void slot_remove(twheel* w, uint level, uint slot, listobj* pObj){
+	listobj** ppHead = &w->pSlot[level][slot];
+	if(pObj->pNext == pObj){
+		*ppHead = NULL;
+		w->Bitmap[level][slot >> 5] &= ~(1U << (slot & 31));
+	}else{
+		pObj->pPrevious->pNext = pObj->pNext;
+		pObj->pNext->pPrevious = pObj->pPrevious;
+		if(*ppHead == pObj) *ppHead = pObj->pNext;
+	}
+	pObj->pNext = pObj->pPrevious = NULL;
+}
+
+static void tw_place(twheel* w, listobj* pObj, uint nExpire){
+	//nExpire >= nNow
+	uint diff = (nExpire ^ w->nNow) >> TW_BITS;
+	uint level = 0;
+	uint slot;
+	while(diff){
+		level++;
+		diff >>= TW_BITS;
+	}
+	slot = (nExpire >> (level * TW_BITS)) & (TW_SLOTS - 1);
+	pObj->nIndex = level * TW_SLOTS + slot;
+	slot_push(w, level, slot, pObj);
+}
+
+static listobj* tw_detach(twheel* w, uint level, uint slot){
+	//Take a whole slot as a NULL terminated chain
+	listobj* pFirst = w->pSlot[level][slot];
+	if(pFirst){
+		pFirst->pPrevious->pNext = NULL;
+		w->pSlot[level][slot] = NULL;
+		w->Bitmap[level][slot >> 5] &= ~(1U << (slot & 31));
+	}
+	return pFirst;
+}
+
+void tw_insertObj(twheel* w, listobj* pObj){
+	//Expired or current ticks are released on the next tick
+	tw_place(w, pObj, pObj->nTCnt > w->nNow ? pObj->nTCnt : w->nNow + 1);
+	w->nCount++;
+}
+
+void tw_extractObj(twheel* w, listobj* pObj){
+	slot_remove(w, pObj->nIndex / TW_SLOTS, pObj->nIndex % TW_SLOTS, pObj);
+	w->nCount--;
+}
+
+listobj* tw_advance(twheel* w, uint nNow){
+	//Step the wheel up to nNow and return all expired items as one
+	//chain linked through pNext
+	listobj* pExpired = NULL;
+	listobj* pLast = NULL;
+	while(w->nNow != nNow){
+		listobj* pObj;
+		uint level = 1;
+		w->nNow++;
+		if(!w->nCount) continue;
+		while(level < TW_LEVELS && !(w->nNow & ((1U << (level * TW_BITS)) - 1)))
+			level++;
+		while(--level > 0){ //Cascade from the highest boundary crossed
+			pObj = tw_detach(w, level, (w->nNow >> (level * TW_BITS)) & (TW_SLOTS - 1));
+			while(pObj){
+				listobj* pNext = pObj->pNext;
+				tw_place(w, pObj, pObj->nTCnt > w->nNow ? pObj->nTCnt : w->nNow);
+				pObj = pNext;
+			}
+		}
+		pObj = tw_detach(w, 0, w->nNow & (TW_SLOTS - 1));
+		if(pObj){
+			if(pLast) pLast->pNext = pObj;
+			else pExpired = pObj;
+			while(pObj){
+				w->nCount--;
+				pLast = pObj;
+				pObj = pObj->pNext;
+			}
+		}
+	}
+	return pExpired;
+}
+
+uint tw_next(twheel* w){
+	//Tick of the next slot in use, never later than the earliest
+	//expiry. Exact for level 0, the start of a cascade otherwise.
+	//~0 if the wheel is empty.
+	uint level;
+	if(!w->nCount) return ~0U;
+	for(level = 0; level < TW_LEVELS; level++){
+		uint shift = level * TW_BITS;
+		uint slot = ((w->nNow >> shift) & (TW_SLOTS - 1)) + 1;
+		while(slot < TW_SLOTS){
+			uint bits = w->Bitmap[level][slot >> 5] >> (slot & 31);
+			if(bits){
+				uint high = shift + TW_BITS < 32 ? w->nNow >> (shift + TW_BITS) << (shift + TW_BITS) : 0;
+				return high | ((slot + tw_ffs(bits)) << shift);
+			}
+			slot = (slot | 31) + 1;
+		}
+	}
+	return ~0U;
+}
+
+void tw_setTime(twheel* w, uint nNow){
+	//Move the wheel to a new time base, all items are placed again
+	listobj* pAll = NULL;
+	uint level, slot;
+	for(level = 0; level < TW_LEVELS; level++){
+		for(slot = 0; slot < TW_SLOTS; slot++){
+			listobj* pObj = tw_detach(w, level, slot);
+			while(pObj){
+				listobj* pNext = pObj->pNext;
+				pObj->pNext = pAll;
+				pAll = pObj;
+				pObj = pNext;
+			}
+		}
+	}
+	w->nNow = nNow;
+	w->nCount = 0;
+	while(pAll){
+		listobj* pNext = pAll->pNext;
+		tw_insertObj(w, pAll);
+		pAll = pNext;
+	}
+}
+
+twheel* create_twheel(uint nNow){
+	twheel* w = (twheel*)calloc(1, sizeof(twheel));
+	if(!w) return NULL;
+	w->nNow = nNow;
+	return w;
+}
+
+void deleteTwheel(twheel* w){
+	free(w);
+}
@@ -0,0 +1,29 @@
+#ifndef TWHEEL_H
+#define TWHEEL_H
+
+#include "kernel.h"
+
+/*********************************************************/
+/** Hierarchical timing wheel used for the Timerlist     */
+/*********************************************************/
+
+#define TW_BITS         6                       // log2 of slots per level
+#define TW_SLOTS        (1 << TW_BITS)
+#define TW_LEVELS       6                       // TW_BITS * TW_LEVELS >= 32
+
+typedef struct tw {
+        uint            nNow;                   // Last tick processed
+        uint            nCount;
+        uint            Bitmap[TW_LEVELS][TW_SLOTS / 32];       // Slot in use
+        listobj         *pSlot[TW_LEVELS][TW_SLOTS];    // Circular lists
+} twheel;
+
+twheel*         create_twheel( uint nNow );
+void            tw_insertObj( twheel* w, listobj* pObj );
+void            tw_extractObj( twheel* w, listobj* pObj );
+listobj*        tw_advance( twheel* w, uint nNow );
+uint            tw_next( twheel* w );
+void            tw_setTime( twheel* w, uint nNow );
+void            deleteTwheel( twheel* w );
+
+#endif